@@ -21,6 +21,10 @@
 #include <linux/types.h>
 #include <linux/pci.h>
 #include <linux/interrupt.h>
+#include <linux/poll.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
+#include <linux/goldfish_audio.h>
 
 #include <asm/types.h>
 #include <asm/io.h>
@@ -34,6 +38,16 @@ MODULE_DESCRIPTION("Android QEMU Audio Driver");
 MODULE_LICENSE("GPL");
 MODULE_VERSION("1.0");
 
+/* One direction of the ring mode, see <linux/goldfish_audio.h> */
+struct goldfish_audio_ring {
+	char *virt;
+	unsigned long phys;
+	unsigned int regs;          /* AUDIO_PLAYBACK_RING or AUDIO_CAPTURE_RING */
+	u32 hw_ptr;                 /* last position reported by the emulator */
+	u32 appl_ptr;
+	int running;                /* ring handed to the emulator */
+};
+
 struct goldfish_audio {
 	char __iomem *reg_base;  
 	int irq;
@@ -48,8 +62,22 @@ struct goldfish_audio {
 	char __iomem *read_buffer;      /* read buffer virtual address */
 	int buffer_status;
 	int read_supported;         /* true if we have audio input support */
+
+	int ring_supported;         /* true if the ring mode is used */
+	unsigned int ring_bytes;    /* size of each ring */
+	struct goldfish_audio_ring playback;
+	struct goldfish_audio_ring capture;
 };
 
+/* Ring mode geometry, used when the emulator supports it */
+static int periods = 8;
+module_param(periods, int, S_IRUGO);
+MODULE_PARM_DESC(periods, "Number of periods in the audio rings");
+
+static int period_bytes = 2048;
+module_param(period_bytes, int, S_IRUGO);
+MODULE_PARM_DESC(period_bytes, "Size of an audio ring period in bytes");
+
 /* We will allocate two read buffers and two write buffers.
    Having two read buffers facilitate stereo -> mono conversion.
    Having two write buffers facilitate interleaved IO.
@@ -87,6 +115,20 @@ enum {
 	/* number of bytes available in read buffer */
 	AUDIO_READ_BUFFER_AVAILABLE  = 0x24,
 
+	/* true if the ring mode is supported, 0 on older emulators */
+	AUDIO_RING_SUPPORTED = 0x28,
+
+	/* register blocks of the playback and capture rings */
+	AUDIO_PLAYBACK_RING  = 0x2C,
+	AUDIO_CAPTURE_RING   = 0x40,
+
+	/* offsets within a ring register block */
+	AUDIO_RING_ADDR        = 0x00,  /* physical address of the ring */
+	AUDIO_RING_PERIOD_SIZE = 0x04,  /* period size in bytes */
+	AUDIO_RING_PERIODS     = 0x08,  /* number of periods, 0 stops the ring */
+	AUDIO_RING_APPL_PTR    = 0x0C,  /* write: bytes written/consumed by guest */
+	AUDIO_RING_HW_PTR      = 0x10,  /* read: bytes played/captured by host */
+
 	/* AUDIO_INT_STATUS bits */
 	
 	/* this bit set when it is safe to write more bytes to the buffer */
@@ -97,11 +139,150 @@ enum {
 	AUDIO_INT_MASK                  = AUDIO_INT_WRITE_BUFFER_1_EMPTY | 
 	                                  AUDIO_INT_WRITE_BUFFER_2_EMPTY | 
 	                                  AUDIO_INT_READ_BUFFER_FULL,
+
+	/* ring mode: a playback or capture period elapsed */
+	AUDIO_INT_PLAYBACK_PERIOD       = 1U << 3,
+	AUDIO_INT_CAPTURE_PERIOD        = 1U << 4,
+
+	AUDIO_INT_RING_MASK             = AUDIO_INT_PLAYBACK_PERIOD |
+	                                  AUDIO_INT_CAPTURE_PERIOD,
 };
 
 
 static atomic_t open_count = ATOMIC_INIT(0);
 
+/* Bytes the application can write (playback) or read (capture), never
+ * more than one ring even if the emulator ran past the application. */
+static u32 goldfish_audio_ring_avail(struct goldfish_audio *data,
+				     struct goldfish_audio_ring *ring)
+{
+	s32 fill;
+
+	if (ring == &data->playback) {
+		fill = ring->appl_ptr - ring->hw_ptr;
+		if (fill <= 0)
+			return data->ring_bytes;
+		return fill >= data->ring_bytes ? 0 : data->ring_bytes - fill;
+	}
+	fill = ring->hw_ptr - ring->appl_ptr;
+	if (fill <= 0)
+		return 0;
+	return min_t(u32, fill, data->ring_bytes);
+}
+
+/* The emulator overwrote capture data the application had not read yet */
+static int goldfish_audio_ring_overrun(struct goldfish_audio *data,
+				       struct goldfish_audio_ring *ring)
+{
+	return ring == &data->capture &&
+	       (s32)(ring->hw_ptr - ring->appl_ptr) > (s32)data->ring_bytes;
+}
+
+static void goldfish_audio_ring_start(struct goldfish_audio *data,
+				      struct goldfish_audio_ring *ring)
+{
+	ring->hw_ptr = 0;
+	ring->appl_ptr = 0;
+	ring->running = 1;
+	GOLDFISH_AUDIO_WRITE(data, ring->regs + AUDIO_RING_ADDR, ring->phys);
+	GOLDFISH_AUDIO_WRITE(data, ring->regs + AUDIO_RING_PERIOD_SIZE,
+			     period_bytes);
+	GOLDFISH_AUDIO_WRITE(data, ring->regs + AUDIO_RING_PERIODS, periods);
+}
+
+static void goldfish_audio_ring_stop(struct goldfish_audio *data,
+				     struct goldfish_audio_ring *ring)
+{
+	if (ring->running)
+		GOLDFISH_AUDIO_WRITE(data, ring->regs + AUDIO_RING_PERIODS, 0);
+	ring->running = 0;
+}
+
+/* Capture is only started once the application uses it, so that opening
+ * the device for playback does not turn the host microphone on. */
+static void goldfish_audio_capture_start(struct goldfish_audio *data)
+{
+	unsigned long irq_flags;
+
+	spin_lock_irqsave(&data->lock, irq_flags);
+	if (!data->capture.running)
+		goldfish_audio_ring_start(data, &data->capture);
+	spin_unlock_irqrestore(&data->lock, irq_flags);
+}
+
+/* Move appl_ptr forward and let the emulator know. Called with data->lock
+ * held. */
+static void goldfish_audio_ring_advance(struct goldfish_audio *data,
+					struct goldfish_audio_ring *ring,
+					u32 bytes)
+{
+	ring->appl_ptr += bytes;
+	GOLDFISH_AUDIO_WRITE(data, ring->regs + AUDIO_RING_APPL_PTR,
+			     ring->appl_ptr);
+}
+
+/* Drop everything the emulator overwrote and carry on from its current
+ * position. Called with data->lock held. */
+static void goldfish_audio_ring_resync(struct goldfish_audio *data,
+				       struct goldfish_audio_ring *ring)
+{
+	goldfish_audio_ring_advance(data, ring, ring->hw_ptr - ring->appl_ptr);
+}
+
+/* read() and write() in ring mode: copy between the user buffer and the
+ * ring, blocking until some room or data is available. A capture overrun
+ * resyncs to the emulator and fails with -EPIPE, like ALSA does. */
+static ssize_t goldfish_audio_ring_copy(struct goldfish_audio *data,
+					struct goldfish_audio_ring *ring,
+					char __user *buf, size_t count)
+{
+	unsigned long irq_flags;
+	ssize_t result = 0;
+	int overrun;
+
+	while (count > 0) {
+		u32 avail, offset, copy;
+
+		if (wait_event_interruptible(data->wait,
+				goldfish_audio_ring_avail(data, ring) > 0))
+			return result ? result : -ERESTARTSYS;
+
+		spin_lock_irqsave(&data->lock, irq_flags);
+		overrun = goldfish_audio_ring_overrun(data, ring);
+		if (overrun)
+			goldfish_audio_ring_resync(data, ring);
+		avail = goldfish_audio_ring_avail(data, ring);
+		spin_unlock_irqrestore(&data->lock, irq_flags);
+		if (overrun)
+			return result ? result : -EPIPE;
+
+		offset = ring->appl_ptr % data->ring_bytes;
+		copy = min_t(u32, count, avail);
+		copy = min_t(u32, copy, data->ring_bytes - offset);
+
+		if (ring == &data->playback ?
+		    copy_from_user(ring->virt + offset, buf, copy) :
+		    copy_to_user(buf, ring->virt + offset, copy))
+			return result ? result : -EFAULT;
+
+		/* the emulator may have overwritten what we just copied */
+		spin_lock_irqsave(&data->lock, irq_flags);
+		overrun = goldfish_audio_ring_overrun(data, ring);
+		if (overrun)
+			goldfish_audio_ring_resync(data, ring);
+		else
+			goldfish_audio_ring_advance(data, ring, copy);
+		spin_unlock_irqrestore(&data->lock, irq_flags);
+		if (overrun)
+			return result ? result : -EPIPE;
+
+		buf += copy;
+		result += copy;
+		count -= copy;
+	}
+	return result;
+}
+
 
 static ssize_t goldfish_audio_read(struct file *fp, char __user *buf,
 							size_t count, loff_t *pos)
@@ -113,6 +294,12 @@ static ssize_t goldfish_audio_read(struct file *fp, char __user *buf,
 	if (!data->read_supported)
 		return -ENODEV;
 
+	if (data->ring_supported) {
+		goldfish_audio_capture_start(data);
+		return goldfish_audio_ring_copy(data, &data->capture, buf,
+						count);
+	}
+
 	while (count > 0) {
 		length = (count > READ_BUFFER_SIZE ? READ_BUFFER_SIZE : count);
 		GOLDFISH_AUDIO_WRITE(data, AUDIO_START_READ, length);
@@ -144,6 +331,10 @@ static ssize_t goldfish_audio_write(struct file *fp, const char __user *buf,
 	ssize_t result = 0;
 	char __iomem *kbuf;
 
+	if (data->ring_supported)
+		return goldfish_audio_ring_copy(data, &data->playback,
+						(char __user *)buf, count);
+
 	while (count > 0)
 	{
 		ssize_t copy = count;
@@ -198,7 +389,12 @@ static int goldfish_audio_open(struct inode *ip, struct file *fp)
 	{
 		fp->private_data = audio_data;
 		audio_data->buffer_status = (AUDIO_INT_WRITE_BUFFER_1_EMPTY | AUDIO_INT_WRITE_BUFFER_2_EMPTY);
-		GOLDFISH_AUDIO_WRITE(audio_data, AUDIO_INT_ENABLE, AUDIO_INT_MASK);
+		if (audio_data->ring_supported) {
+			goldfish_audio_ring_start(audio_data, &audio_data->playback);
+			GOLDFISH_AUDIO_WRITE(audio_data, AUDIO_INT_ENABLE,
+					     AUDIO_INT_RING_MASK);
+		} else
+			GOLDFISH_AUDIO_WRITE(audio_data, AUDIO_INT_ENABLE, AUDIO_INT_MASK);
 		return 0;
 	} 
 	else 
@@ -212,11 +408,126 @@ static int goldfish_audio_release(struct inode *ip, struct file* fp)
 {
 	atomic_dec(&open_count);
 	GOLDFISH_AUDIO_WRITE(audio_data, AUDIO_INT_ENABLE, 0);
+	if (audio_data->ring_supported) {
+		goldfish_audio_ring_stop(audio_data, &audio_data->playback);
+		goldfish_audio_ring_stop(audio_data, &audio_data->capture);
+	}
 	return 0;
 }
-	   
+
+static unsigned int goldfish_audio_poll(struct file *fp, poll_table *wait)
+{
+	struct goldfish_audio *data = fp->private_data;
+	unsigned int mask = 0;
+
+	if (!data->ring_supported) {
+		mask = POLLOUT | POLLWRNORM;
+		if (data->read_supported)
+			mask |= POLLIN | POLLRDNORM;
+		return mask;
+	}
+
+	/* polling a readable file counts as using the capture side */
+	if (data->read_supported && (fp->f_mode & FMODE_READ))
+		goldfish_audio_capture_start(data);
+
+	poll_wait(fp, &data->wait, wait);
+	if (goldfish_audio_ring_avail(data, &data->playback) >= period_bytes)
+		mask |= POLLOUT | POLLWRNORM;
+	if (data->capture.running &&
+	    goldfish_audio_ring_avail(data, &data->capture) >= period_bytes)
+		mask |= POLLIN | POLLRDNORM;
+	return mask;
+}
+
+/* Map the playback ring, followed by the capture ring */
+static int goldfish_audio_mmap(struct file *fp, struct vm_area_struct *vma)
+{
+	struct goldfish_audio *data = fp->private_data;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	unsigned long offset = vma->vm_pgoff << PAGE_SHIFT;
+	unsigned long total = data->ring_bytes *
+			      (data->read_supported ? 2 : 1);
+
+	if (!data->ring_supported)
+		return -ENODEV;
+	if (offset >= total || size > total - offset)
+		return -EINVAL;
+	if (offset + size > data->ring_bytes)
+		goldfish_audio_capture_start(data);
+
+	vma->vm_flags |= VM_RESERVED | VM_DONTEXPAND;
+	return remap_pfn_range(vma, vma->vm_start,
+			       (data->playback.phys + offset) >> PAGE_SHIFT,
+			       size, vma->vm_page_prot);
+}
+
+static int goldfish_audio_ring_ioctl(struct goldfish_audio *data,
+				     unsigned int cmd, unsigned long arg)
+{
+	struct goldfish_audio_ring_info info;
+	struct goldfish_audio_pos pos;
+	struct goldfish_audio_ring *ring;
+	unsigned long irq_flags;
+	int ret = 0;
+
+	if (cmd == GOLDFISH_AUDIO_GET_RING_INFO) {
+		info.period_bytes = period_bytes;
+		info.periods = periods;
+		info.playback_offset = 0;
+		info.capture_offset = data->read_supported ? data->ring_bytes : 0;
+		return copy_to_user((void __user *)arg, &info, sizeof(info)) ?
+			-EFAULT : 0;
+	}
+
+	if (copy_from_user(&pos, (void __user *)arg, sizeof(pos)))
+		return -EFAULT;
+	if (pos.dir == GOLDFISH_AUDIO_PLAYBACK)
+		ring = &data->playback;
+	else if (pos.dir == GOLDFISH_AUDIO_CAPTURE && data->read_supported)
+		ring = &data->capture;
+	else
+		return -EINVAL;
+	if (ring == &data->capture)
+		goldfish_audio_capture_start(data);
+
+	spin_lock_irqsave(&data->lock, irq_flags);
+	if (cmd == GOLDFISH_AUDIO_GET_POS) {
+		ring->hw_ptr = GOLDFISH_AUDIO_READ(data,
+					ring->regs + AUDIO_RING_HW_PTR);
+		pos.hw_ptr = ring->hw_ptr;
+		pos.appl_ptr = ring->appl_ptr;
+	} else if (goldfish_audio_ring_overrun(data, ring)) {
+		goldfish_audio_ring_resync(data, ring);
+		ret = -EPIPE;
+	} else if (pos.appl_ptr - ring->appl_ptr >
+		   goldfish_audio_ring_avail(data, ring)) {
+		ret = -EINVAL;
+	} else {
+		goldfish_audio_ring_advance(data, ring,
+					    pos.appl_ptr - ring->appl_ptr);
+	}
+	spin_unlock_irqrestore(&data->lock, irq_flags);
+
+	if (ret == 0 && cmd == GOLDFISH_AUDIO_GET_POS &&
+	    copy_to_user((void __user *)arg, &pos, sizeof(pos)))
+		ret = -EFAULT;
+	return ret;
+}
+
 static int goldfish_audio_ioctl(struct inode* ip, struct file* fp, unsigned int cmd, unsigned long arg)
 {
+	struct goldfish_audio *data = fp->private_data;
+
+	switch (cmd) {
+	case GOLDFISH_AUDIO_GET_RING_INFO:
+	case GOLDFISH_AUDIO_GET_POS:
+	case GOLDFISH_AUDIO_ADVANCE:
+		if (!data->ring_supported)
+			return -ENOTTY;
+		return goldfish_audio_ring_ioctl(data, cmd, arg);
+	}
+
 	/* temporary workaround, until we switch to the ALSA API */
 	if (cmd == 315)
 		return -1;
@@ -235,12 +546,19 @@ goldfish_audio_interrupt(int irq, void *dev_id)
 	
 	/* read buffer status flags */
 	status = GOLDFISH_AUDIO_READ(data, AUDIO_INT_STATUS);
-	status &= AUDIO_INT_MASK;
+	status &= AUDIO_INT_MASK | AUDIO_INT_RING_MASK;
 	/* if buffers are newly empty, wake up blocked goldfish_audio_write() call */
-	if(status) {
-		data->buffer_status = status;
+	if (status & AUDIO_INT_MASK)
+		data->buffer_status = status & AUDIO_INT_MASK;
+	/* ring mode: pick up the new positions */
+	if (status & AUDIO_INT_PLAYBACK_PERIOD)
+		data->playback.hw_ptr = GOLDFISH_AUDIO_READ(data,
+				AUDIO_PLAYBACK_RING + AUDIO_RING_HW_PTR);
+	if (status & AUDIO_INT_CAPTURE_PERIOD)
+		data->capture.hw_ptr = GOLDFISH_AUDIO_READ(data,
+				AUDIO_CAPTURE_RING + AUDIO_RING_HW_PTR);
+	if (status)
 		wake_up(&data->wait);
-	}
 	
 	spin_unlock_irqrestore(&data->lock, irq_flags);
 	return status ? IRQ_HANDLED : IRQ_NONE;
@@ -253,6 +571,8 @@ static struct file_operations goldfish_audio_fops = {
 	.write = goldfish_audio_write,
 	.open = goldfish_audio_open,
 	.release = goldfish_audio_release,
+	.poll = goldfish_audio_poll,
+	.mmap = goldfish_audio_mmap,
    .ioctl = goldfish_audio_ioctl,
 
 };
@@ -263,6 +583,38 @@ static struct miscdevice goldfish_audio_device = {
 	.fops = &goldfish_audio_fops,
 };
 
+/* Allocate the rings used instead of the fixed buffers, so they can be
+ * mapped to userspace. Rings are page multiples so both can be mapped
+ * separately. */
+static void goldfish_audio_setup_rings(struct goldfish_audio *data)
+{
+	unsigned int ring_bytes = periods * period_bytes;
+	unsigned long virt;
+
+	/* appl_ptr and hw_ptr are free running u32 byte counts, reduced
+	 * modulo ring_bytes, so the ring must divide 2^32 */
+	if (periods < 2 || period_bytes <= 0 || !is_power_of_2(ring_bytes) ||
+	    ring_bytes % PAGE_SIZE) {
+		printk("goldfish_audio: invalid ring geometry %d x %d\n",
+		       periods, period_bytes);
+		return;
+	}
+
+	virt = __get_free_pages(GFP_KERNEL | __GFP_ZERO,
+				get_order(2 * ring_bytes));
+	if (!virt)
+		return;
+
+	data->ring_bytes = ring_bytes;
+	data->playback.virt = (char *)virt;
+	data->playback.phys = __pa(virt);
+	data->playback.regs = AUDIO_PLAYBACK_RING;
+	data->capture.virt = (char *)virt + ring_bytes;
+	data->capture.phys = __pa(virt) + ring_bytes;
+	data->capture.regs = AUDIO_CAPTURE_RING;
+	data->ring_supported = 1;
+}
+
 static int goldfish_audio_probe(struct platform_device *pdev)
 {
 	int ret;
@@ -338,6 +690,9 @@ static int goldfish_audio_probe(struct platform_device *pdev)
 	if (data->read_supported)
 		GOLDFISH_AUDIO_WRITE(data, AUDIO_SET_READ_BUFFER, buf_addr + 2 * WRITE_BUFFER_SIZE);
 
+	if (GOLDFISH_AUDIO_READ(data, AUDIO_RING_SUPPORTED))
+		goldfish_audio_setup_rings(data);
+
 	audio_data = data;
 	return 0;
 
@@ -367,6 +722,9 @@ static int goldfish_audio_remove(struct platform_device *pdev)
 
 	misc_deregister(&goldfish_audio_device);
 	free_irq(data->irq, data);
+	if (data->ring_supported)
+		free_pages((unsigned long)data->playback.virt,
+			   get_order(2 * data->ring_bytes));
 #if defined(CONFIG_ARM)
 	dma_free_writecombine(&pdev->dev, COMBINED_BUFFER_SIZE, data->buffer_virt, data->buffer_phys);
 #elif defined(CONFIG_X86) || defined(CONFIG_MIPS)
@@ -42,6 +42,11 @@
  *
  * Note that we must however ensure that each user page involved in the
  * exchange is properly mapped during a transfer.
+ *
+ * High-rate writers can instead set up a shared ring buffer with the
+ * QEMU_PIPE_SETUP_RING ioctl and mmap() the pipe fd (see
+ * <linux/qemu_pipe.h>). Writes then become a memcpy into the ring, plus a
+ * QEMU_PIPE_RING_KICK when the emulator asks for one.
  */
 
 #include <linux/module.h>
@@ -54,6 +59,12 @@
 #include <linux/sched.h>
 #include <linux/bitops.h>
 #include <linux/io.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/rcupdate.h>
+#include <linux/cache.h>
+#include <linux/uaccess.h>
+#include <linux/qemu_pipe.h>
 
 /* Set to 1 for normal debugging, and 2 for extensive one */
 #define PIPE_DEBUG  0
@@ -84,6 +95,18 @@
 #define PIPE_REG_PARAMS_ADDR_LOW     0x18  /* read/write: batch data address */
 #define PIPE_REG_PARAMS_ADDR_HIGH    0x1c  /* read/write: batch data address */
 #define PIPE_REG_ACCESS_PARAMS       0x20  /* write: batch access */
+#define PIPE_REG_VERSION             0x24  /* read: device version */
+#define PIPE_REG_SLOT_INDEX          0x28  /* write: slot for PARAMS_ADDR */
+#define PIPE_REG_ACCESS_SLOT         0x2c  /* write: batch access, per slot */
+#define PIPE_REG_WAKE_AREA_LOW       0x30  /* write: wake area address */
+#define PIPE_REG_WAKE_AREA_HIGH      0x34  /* write: wake area address */
+
+/* Device versions reported through PIPE_REG_VERSION. Older emulators
+ * return 0 for this register (see valid_batchbuffer_addr() below).
+ */
+#define PIPE_VERSION_VECTORED  1  /* CMD_{WRITE,READ}_BUFFER_VEC supported */
+#define PIPE_VERSION_MULTIQUEUE 2  /* per-CPU slots and shared wake area */
+#define PIPE_VERSION_RING      3  /* CMD_SETUP_RING/CMD_RING_KICK supported */
 
 /* list of commands for PIPE_REG_COMMAND */
 #define CMD_OPEN               1  /* open new channel */
@@ -109,6 +132,22 @@
 #define CMD_WAKE_ON_READ       7  /* tell the emulator to wake us when reading
 				   * is possible */
 
+/* Vectored variants of CMD_WRITE_BUFFER/CMD_READ_BUFFER, only available
+ * through PIPE_REG_ACCESS_PARAMS. 'address' is the physical address of an
+ * array of struct pipe_buffer_desc, 'flags' the number of entries in it and
+ * 'size' the total number of bytes they describe.
+ */
+#define CMD_WRITE_BUFFER_VEC   8  /* send a list of guest pages */
+#define CMD_READ_BUFFER_VEC    9  /* receive into a list of guest pages */
+
+/* Shared ring buffer commands. CMD_SETUP_RING takes the same page list as
+ * the vectored commands, starting with the struct qemu_pipe_ring header
+ * page, with 'size' set to the data area size. The ring stays registered
+ * until the channel is closed.
+ */
+#define CMD_SETUP_RING        10  /* register the channel's ring pages */
+#define CMD_RING_KICK         11  /* new data is available in the ring */
+
 /* Possible status values used to signal errors - see qemu_pipe_error_convert */
 #define PIPE_ERROR_INVAL       -1
 #define PIPE_ERROR_AGAIN       -2
@@ -130,6 +169,47 @@ struct access_params{
 	uint32_t flags;
 };
 
+/* One physically contiguous chunk of a pinned user buffer, as passed to
+ * the emulator by the vectored buffer commands.
+ */
+struct pipe_buffer_desc {
+	uint64_t address;
+	uint32_t size;
+	uint32_t reserved;
+};
+
+/* Maximum number of descriptors handed to the emulator in one vectored
+ * command: one page worth, i.e. 1 MiB of data with 4 KiB pages.
+ */
+#define PIPE_MAX_BATCH_PAGES  (PAGE_SIZE / sizeof(struct pipe_buffer_desc))
+
+/* In multi-queue mode, each possible CPU owns one access_params block,
+ * registered once through PIPE_REG_SLOT_INDEX/PIPE_REG_PARAMS_ADDR_*.
+ * Writing a CPU number to PIPE_REG_ACCESS_SLOT runs the command stored in
+ * that CPU's block, so commands from different CPUs never share state and
+ * need no device lock.
+ */
+struct pipe_slot {
+	struct access_params aps;
+} ____cacheline_aligned_in_smp;
+
+/* Number of channels with a wake area index in multi-queue mode. Channels
+ * opened beyond that are still usable, with legacy wake signalling.
+ */
+#define PIPE_MQ_MAX_CHANNELS   1024
+
+/* Wake events in multi-queue mode. Instead of the (channel, wakes) register
+ * list, the emulator ORs PIPE_WAKE_* bits into flags[id] and then sets bit
+ * 'id' in 'mask' before raising the interrupt, where 'id' is the small
+ * channel index handed over in CMD_OPEN. The interrupt handler consumes
+ * both with atomic exchanges, without taking any lock. A channel opened
+ * with index 0 (no wake area slot) is reported through the registers.
+ */
+struct pipe_wake_area {
+	unsigned long mask[BITS_TO_LONGS(PIPE_MQ_MAX_CHANNELS)];
+	u32 flags[PIPE_MQ_MAX_CHANNELS];
+};
+
 /* The global driver data. Holds a reference to the i/o page used to
  * communicate with the emulator, and a wake queue for blocked tasks
  * waiting to be awoken.
@@ -139,6 +219,17 @@ struct qemu_pipe_dev {
 	unsigned char __iomem *base;
 	struct access_params *aps;
 	int irq;
+	u32 version;
+
+	/* Multi-queue mode, see struct pipe_slot and struct pipe_wake_area.
+	 * 'lock' is only used for legacy register accesses once enabled.
+	 */
+	int multiqueue;
+	struct pipe_slot *slots;
+	struct pipe_wake_area *wake_area;
+	unsigned long channel_map[BITS_TO_LONGS(PIPE_MQ_MAX_CHANNELS)];
+	struct qemu_pipe *channels[PIPE_MQ_MAX_CHANNELS];
+	atomic_t legacy_channels;	/* open channels without a wake slot */
 };
 
 static struct qemu_pipe_dev   pipe_dev[1];
@@ -149,6 +240,17 @@ struct qemu_pipe {
 	struct mutex lock;
 	unsigned long flags;
 	wait_queue_head_t wake_queue;
+	/* Page list of vectored transfers, allocated on first use and
+	 * protected by 'lock' */
+	struct pipe_buffer_desc *descs;
+	struct page **pages;
+	/* Shared ring buffer, header page first; protected by 'lock' */
+	struct page **ring_pages;
+	int ring_nr_pages;
+	struct qemu_pipe_ring *ring;
+	/* Index in dev->channels, multi-queue mode only */
+	int id;
+	struct rcu_head rcu;
 };
 
 
@@ -220,11 +322,93 @@ static int setup_access_params_addr(struct qemu_pipe_dev *dev)
 	    return -1;
 }
 
+/* Forget the parameter blocks of the CPUs up to 'last', so the emulator
+ * never writes to them once they are freed.
+ */
+static void clear_multiqueue_slots(struct qemu_pipe_dev *dev, int last)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (cpu > last)
+			break;
+		writel(cpu, dev->base + PIPE_REG_SLOT_INDEX);
+		writel(0, dev->base + PIPE_REG_PARAMS_ADDR_HIGH);
+		writel(0, dev->base + PIPE_REG_PARAMS_ADDR_LOW);
+	}
+}
+
+/* Switch the device to multi-queue mode: register one parameter block per
+ * possible CPU and the shared wake area. 0 on success, in which case the
+ * legacy register paths are only used as a fallback.
+ */
+static int setup_multiqueue(struct qemu_pipe_dev *dev)
+{
+	struct pipe_slot *slots;
+	struct pipe_wake_area *area;
+	uint64_t paddr;
+	int cpu;
+
+	if (dev->aps == NULL || dev->version < PIPE_VERSION_MULTIQUEUE)
+		return -1;
+
+	slots = kzalloc(nr_cpu_ids * sizeof(*slots), GFP_KERNEL);
+	area = kzalloc(sizeof(*area), GFP_KERNEL);
+	if (!slots || !area)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		writel(cpu, dev->base + PIPE_REG_SLOT_INDEX);
+		paddr = __pa(&slots[cpu].aps);
+		writel((uint32_t)(paddr >> 32),
+		  dev->base + PIPE_REG_PARAMS_ADDR_HIGH);
+		writel((uint32_t)paddr,
+		  dev->base + PIPE_REG_PARAMS_ADDR_LOW);
+		if (!valid_batchbuffer_addr(dev, &slots[cpu].aps)) {
+			clear_multiqueue_slots(dev, cpu);
+			goto fail;
+		}
+	}
+
+	dev->slots = slots;
+	dev->wake_area = area;
+	dev->multiqueue = 1;
+
+	/* From now on, wakes are reported through the wake area */
+	paddr = __pa(area);
+	writel((uint32_t)(paddr >> 32), dev->base + PIPE_REG_WAKE_AREA_HIGH);
+	writel((uint32_t)paddr, dev->base + PIPE_REG_WAKE_AREA_LOW);
+	return 0;
+
+fail:
+	kfree(area);
+	kfree(slots);
+	return -1;
+}
+
+/* Undo setup_multiqueue(), going back to the legacy register paths */
+static void teardown_multiqueue(struct qemu_pipe_dev *dev)
+{
+	if (!dev->multiqueue)
+		return;
+
+	writel(0, dev->base + PIPE_REG_WAKE_AREA_HIGH);
+	writel(0, dev->base + PIPE_REG_WAKE_AREA_LOW);
+	clear_multiqueue_slots(dev, nr_cpu_ids - 1);
+
+	dev->multiqueue = 0;
+	kfree(dev->slots);
+	kfree(dev->wake_area);
+	dev->slots = NULL;
+	dev->wake_area = NULL;
+}
+
 /* A value that will not be set by qemu emulator */
 #define INITIAL_BATCH_RESULT (0xdeadbeaf)
 static int access_with_param(struct qemu_pipe_dev *dev, const int cmd,
                              unsigned long address, unsigned long avail,
-                             struct qemu_pipe *pipe, int *status)
+                             uint32_t flags, struct qemu_pipe *pipe,
+                             int *status)
 {
 	struct access_params *aps = dev->aps;
 
@@ -236,6 +420,7 @@ static int access_with_param(struct qemu_pipe_dev *dev, const int cmd,
 	aps->size = avail;
 	aps->address = address;
 	aps->cmd = cmd;
+	aps->flags = flags;
 	writel(cmd, dev->base + PIPE_REG_ACCESS_PARAMS);
 	/* If the aps->result is not changed, or that means batch command failed */
 	if (aps->result == INITIAL_BATCH_RESULT)
@@ -244,6 +429,172 @@ static int access_with_param(struct qemu_pipe_dev *dev, const int cmd,
 	return 0;
 }
 
+/* Multi-queue counterpart of access_with_param(): the command goes through
+ * the current CPU's slot, so no device lock is taken.
+ */
+static int access_with_slot(struct qemu_pipe_dev *dev, const int cmd,
+			    unsigned long address, unsigned long avail,
+			    uint32_t flags, struct qemu_pipe *pipe,
+			    int *status)
+{
+	int cpu = get_cpu();
+	struct access_params *aps = &dev->slots[cpu].aps;
+	int ret = 0;
+
+	aps->result = INITIAL_BATCH_RESULT;
+	aps->channel = (unsigned long)pipe;
+	aps->size = avail;
+	aps->address = address;
+	aps->cmd = cmd;
+	aps->flags = flags;
+	writel(cpu, dev->base + PIPE_REG_ACCESS_SLOT);
+	if (aps->result == INITIAL_BATCH_RESULT)
+		ret = -1;
+	else
+		*status = aps->result;
+	put_cpu();
+	return ret;
+}
+
+/* Run a command through the batch parameter block, using the per-CPU slots
+ * in multi-queue mode and the shared block under dev->lock otherwise.
+ * Returns -1 if the emulator doesn't support batch access.
+ */
+static int qemu_pipe_access(struct qemu_pipe *pipe, const int cmd,
+			    unsigned long address, unsigned long avail,
+			    uint32_t flags, int *status)
+{
+	struct qemu_pipe_dev *dev = pipe->dev;
+	unsigned long irq_flags;
+	int ret;
+
+	if (dev->multiqueue)
+		return access_with_slot(dev, cmd, address, avail, flags,
+					pipe, status);
+
+	spin_lock_irqsave(&dev->lock, irq_flags);
+	ret = access_with_param(dev, cmd, address, avail, flags, pipe, status);
+	spin_unlock_irqrestore(&dev->lock, irq_flags);
+	return ret;
+}
+
+/* Send a simple command (open, close, poll, wake requests) for a given
+ * channel and return the resulting status.
+ */
+static int qemu_pipe_command(struct qemu_pipe *pipe, int cmd, uint32_t flags)
+{
+	struct qemu_pipe_dev *dev = pipe->dev;
+	unsigned long irq_flags;
+	int status;
+
+	if (dev->multiqueue &&
+	    access_with_slot(dev, cmd, 0, 0, flags, pipe, &status) == 0)
+		return status;
+
+	spin_lock_irqsave(&dev->lock, irq_flags);
+	writel((unsigned long)pipe, dev->base + PIPE_REG_CHANNEL);
+	writel(cmd, dev->base + PIPE_REG_COMMAND);
+	status = readl(dev->base + PIPE_REG_STATUS);
+	spin_unlock_irqrestore(&dev->lock, irq_flags);
+	return status;
+}
+
+/* Allocate the page list used by the vectored and ring commands. Called
+ * with pipe->lock held.
+ */
+static int qemu_pipe_alloc_descs(struct qemu_pipe *pipe)
+{
+	if (pipe->descs == NULL) {
+		pipe->descs = (struct pipe_buffer_desc *)
+				__get_free_page(GFP_KERNEL);
+		if (pipe->descs == NULL)
+			return -ENOMEM;
+	}
+	if (pipe->pages == NULL) {
+		pipe->pages = kmalloc(PIPE_MAX_BATCH_PAGES *
+				      sizeof(struct page *), GFP_KERNEL);
+		if (pipe->pages == NULL)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+/* Transfer as much of [address, address_end) as fits in a single vectored
+ * command. The user pages are pinned for the duration of the command, so
+ * the emulator can be handed their physical addresses directly instead of
+ * faulting them in and issuing one command per page.
+ *
+ * Returns 0 and sets *status like CMD_WRITE_BUFFER/CMD_READ_BUFFER would,
+ * or -1 if the caller must fall back to the per-page path. Called with
+ * pipe->lock held.
+ */
+static int qemu_pipe_transfer_vec(struct qemu_pipe *pipe,
+				  unsigned long address,
+				  unsigned long address_end,
+				  int is_write, int *status)
+{
+	struct qemu_pipe_dev *dev = pipe->dev;
+	unsigned long first_page = address & PAGE_MASK;
+	unsigned long total = 0;
+	int nr_pages, pinned, count = 0, i, ret;
+
+	if (dev->aps == NULL || dev->version < PIPE_VERSION_VECTORED)
+		return -1;
+
+	nr_pages = ((address_end - 1) >> PAGE_SHIFT) -
+		   (address >> PAGE_SHIFT) + 1;
+	/* A single page costs the same exit either way */
+	if (nr_pages < 2)
+		return -1;
+	if (nr_pages > PIPE_MAX_BATCH_PAGES)
+		nr_pages = PIPE_MAX_BATCH_PAGES;
+
+	if (qemu_pipe_alloc_descs(pipe))
+		return -1;
+
+	/* Reading from the pipe writes into the user pages */
+	pinned = get_user_pages_fast(first_page, nr_pages, !is_write,
+				     pipe->pages);
+	if (pinned <= 0) {
+		PIPE_D("could not pin user pages at 0x%08lx\n", address);
+		return -1;
+	}
+
+	for (i = 0; i < pinned; i++) {
+		unsigned long page_start = first_page + i * PAGE_SIZE;
+		unsigned long from = max(address, page_start);
+		unsigned long to = min(address_end, page_start + PAGE_SIZE);
+		uint64_t paddr = page_to_phys(pipe->pages[i]) +
+				 (from - page_start);
+
+		/* Merge physically contiguous pages into one descriptor */
+		if (count > 0 && pipe->descs[count - 1].address +
+				 pipe->descs[count - 1].size == paddr) {
+			pipe->descs[count - 1].size += to - from;
+		} else {
+			pipe->descs[count].address = paddr;
+			pipe->descs[count].size = to - from;
+			pipe->descs[count].reserved = 0;
+			count++;
+		}
+		total += to - from;
+	}
+
+	ret = qemu_pipe_access(pipe, is_write ? CMD_WRITE_BUFFER_VEC
+					      : CMD_READ_BUFFER_VEC,
+			       __pa(pipe->descs), total, count, status);
+
+	for (i = 0; i < pinned; i++) {
+		if (!is_write && ret == 0 && *status > 0)
+			set_page_dirty_lock(pipe->pages[i]);
+		put_page(pipe->pages[i]);
+	}
+
+	PIPE_DD("(write=%d) vectored %d pages, %lu bytes, status %d\n",
+		is_write, pinned, total, ret ? ret : *status);
+	return ret;
+}
+
 /* This function is used for both reading from and writing to a given
  * pipe.
  */
@@ -292,6 +643,11 @@ static ssize_t qemu_pipe_read_write(struct file *filp, char __user *buffer,
 		unsigned long  avail    = next - address;
 		int status, wakeBit;
 
+		/* Large buffers go to the emulator as one page list */
+		if (qemu_pipe_transfer_vec(pipe, address, address_end,
+					   is_write, &status) == 0)
+			goto transferred;
+
 		/* Ensure that the corresponding page is properly mapped */
 		if (is_write) {
 			char c;
@@ -315,19 +671,20 @@ static ssize_t qemu_pipe_read_write(struct file *filp, char __user *buffer,
 		}
 
 		/* Now, try to transfer the bytes in the current page */
-		spin_lock_irqsave(&dev->lock, irq_flags);
-		if (access_with_param(dev, CMD_WRITE_BUFFER + cmd_offset, address,
-		      avail, pipe, &status))
+		if (qemu_pipe_access(pipe, CMD_WRITE_BUFFER + cmd_offset,
+		      address, avail, 0, &status))
 		{
+		    spin_lock_irqsave(&dev->lock, irq_flags);
 		    writel((unsigned long)pipe, dev->base + PIPE_REG_CHANNEL);
 		    writel(avail, dev->base + PIPE_REG_SIZE);
 		    writel(address, dev->base + PIPE_REG_ADDRESS);
 		    writel(CMD_WRITE_BUFFER + cmd_offset,
 		      dev->base + PIPE_REG_COMMAND);
 		    status = readl(dev->base + PIPE_REG_STATUS);
+		    spin_unlock_irqrestore(&dev->lock, irq_flags);
 		}
-		spin_unlock_irqrestore(&dev->lock, irq_flags);
 
+transferred:
 		if (status > 0) { /* Correct transfer */
 			ret += status;
 			address += status;
@@ -359,11 +716,7 @@ static ssize_t qemu_pipe_read_write(struct file *filp, char __user *buffer,
 		set_bit(wakeBit, &pipe->flags);
 
 		/* Tell the emulator we're going to wait for a wake event */
-		spin_lock_irqsave(&dev->lock, irq_flags);
-		writel((unsigned long)pipe, dev->base + PIPE_REG_CHANNEL);
-		writel(CMD_WAKE_ON_WRITE + cmd_offset,
-			dev->base + PIPE_REG_COMMAND);
-		spin_unlock_irqrestore(&dev->lock, irq_flags);
+		qemu_pipe_command(pipe, CMD_WAKE_ON_WRITE + cmd_offset, 0);
 
 		/* Unlock the pipe, then wait for the wake signal */
 		mutex_unlock(&pipe->lock);
@@ -410,11 +763,193 @@ static ssize_t qemu_pipe_write(struct file *filp,
 }
 
 
+static void qemu_pipe_free_ring(struct qemu_pipe *pipe)
+{
+	int i;
+
+	for (i = 0; i < pipe->ring_nr_pages; i++)
+		__free_page(pipe->ring_pages[i]);
+	kfree(pipe->ring_pages);
+	pipe->ring_pages = NULL;
+	pipe->ring_nr_pages = 0;
+	pipe->ring = NULL;
+}
+
+/* Allocate a shared ring with 'size' bytes of data and register it with the
+ * emulator. The pages stay allocated, and thus pinned, until the channel is
+ * closed.
+ */
+static int qemu_pipe_setup_ring(struct qemu_pipe *pipe, u32 size)
+{
+	int nr_pages = size / PAGE_SIZE + 1;
+	int status, ret, i;
+
+	if (pipe->dev->version < PIPE_VERSION_RING)
+		return -ENOTTY;
+	if (size < PAGE_SIZE || (size & (size - 1)) ||
+	    nr_pages > PIPE_MAX_BATCH_PAGES)
+		return -EINVAL;
+
+	if (mutex_lock_interruptible(&pipe->lock))
+		return -ERESTARTSYS;
+
+	if (pipe->ring_pages != NULL) {
+		ret = -EBUSY;
+		goto out;
+	}
+	ret = qemu_pipe_alloc_descs(pipe);
+	if (ret)
+		goto out;
+
+	pipe->ring_pages = kcalloc(nr_pages, sizeof(struct page *),
+				   GFP_KERNEL);
+	if (pipe->ring_pages == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+
+		if (page == NULL) {
+			ret = -ENOMEM;
+			goto err_free_ring;
+		}
+		pipe->ring_pages[i] = page;
+		pipe->ring_nr_pages++;
+		pipe->descs[i].address = page_to_phys(page);
+		pipe->descs[i].size = PAGE_SIZE;
+		pipe->descs[i].reserved = 0;
+	}
+	pipe->ring = page_address(pipe->ring_pages[0]);
+	pipe->ring->size = size;
+
+	if (qemu_pipe_access(pipe, CMD_SETUP_RING, __pa(pipe->descs), size,
+			     nr_pages, &status)) {
+		ret = -ENOTTY;
+		goto err_free_ring;
+	}
+	if (status < 0) {
+		ret = qemu_pipe_error_convert(status);
+		goto err_free_ring;
+	}
+
+	PIPE_D("Ring of %u bytes set up for pipe %p\n", size, pipe);
+	mutex_unlock(&pipe->lock);
+	return 0;
+
+err_free_ring:
+	qemu_pipe_free_ring(pipe);
+out:
+	mutex_unlock(&pipe->lock);
+	return ret;
+}
+
+/* Block until the emulator has made room in the shared ring */
+static int qemu_pipe_ring_wait(struct qemu_pipe *pipe)
+{
+	struct qemu_pipe_ring *ring;
+
+	if (mutex_lock_interruptible(&pipe->lock))
+		return -ERESTARTSYS;
+
+	ring = pipe->ring;
+	if (ring == NULL) {
+		mutex_unlock(&pipe->lock);
+		return -EINVAL;
+	}
+
+	while (ACCESS_ONCE(ring->head) - ACCESS_ONCE(ring->tail) >=
+	       pipe->ring_nr_pages * PAGE_SIZE - PAGE_SIZE) {
+		set_bit(BIT_WAKE_ON_WRITE, &pipe->flags);
+		qemu_pipe_command(pipe, CMD_WAKE_ON_WRITE, 0);
+		mutex_unlock(&pipe->lock);
+
+		while (test_bit(BIT_WAKE_ON_WRITE, &pipe->flags)) {
+			if (wait_event_interruptible(
+					pipe->wake_queue,
+					!test_bit(BIT_WAKE_ON_WRITE,
+						  &pipe->flags)))
+				return -ERESTARTSYS;
+
+			if (test_bit(BIT_CLOSED_ON_HOST, &pipe->flags))
+				return -EIO;
+		}
+
+		if (mutex_lock_interruptible(&pipe->lock))
+			return -ERESTARTSYS;
+	}
+	mutex_unlock(&pipe->lock);
+	return 0;
+}
+
+static long qemu_pipe_ioctl(struct file *filp, unsigned int cmd,
+			    unsigned long arg)
+{
+	struct qemu_pipe *pipe = filp->private_data;
+	int status;
+
+	if (test_bit(BIT_CLOSED_ON_HOST, &pipe->flags))
+		return -EIO;
+
+	switch (cmd) {
+	case QEMU_PIPE_SETUP_RING: {
+		u32 size;
+
+		if (get_user(size, (u32 __user *)arg))
+			return -EFAULT;
+		return qemu_pipe_setup_ring(pipe, size);
+	}
+	case QEMU_PIPE_RING_KICK:
+		/* pipe->ring is never reset while the file is open */
+		if (pipe->ring == NULL)
+			return -EINVAL;
+		status = qemu_pipe_command(pipe, CMD_RING_KICK, 0);
+		return status < 0 ? qemu_pipe_error_convert(status) : 0;
+	case QEMU_PIPE_RING_WAIT:
+		return qemu_pipe_ring_wait(pipe);
+	}
+	return -ENOTTY;
+}
+
+/* Map the ring header and data pages set up by QEMU_PIPE_SETUP_RING */
+static int qemu_pipe_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct qemu_pipe *pipe = filp->private_data;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	int ret = 0;
+	int i;
+
+	mutex_lock(&pipe->lock);
+	if (pipe->ring == NULL || vma->vm_pgoff != 0 ||
+	    size != pipe->ring_nr_pages * PAGE_SIZE) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* A store to a private mapping would COW a ring page, leaving the
+	 * guest and the emulator looking at different rings. Private
+	 * mappings are only allowed read-only, and must stay that way.
+	 */
+	if (!(vma->vm_flags & VM_SHARED)) {
+		if (vma->vm_flags & VM_WRITE) {
+			ret = -EINVAL;
+			goto out;
+		}
+		vma->vm_flags &= ~VM_MAYWRITE;
+	}
+
+	vma->vm_flags |= VM_RESERVED | VM_DONTEXPAND;
+	for (i = 0; i < pipe->ring_nr_pages && ret == 0; i++)
+		ret = vm_insert_page(vma, vma->vm_start + i * PAGE_SIZE,
+				     pipe->ring_pages[i]);
+out:
+	mutex_unlock(&pipe->lock);
+	return ret;
+}
+
 static unsigned int qemu_pipe_poll(struct file *filp, poll_table *wait)
 {
 	struct qemu_pipe *pipe = filp->private_data;
-	struct qemu_pipe_dev *dev = pipe->dev;
-	unsigned long irq_flags;
 	unsigned int mask = 0;
 	int status;
 
@@ -422,11 +957,7 @@ static unsigned int qemu_pipe_poll(struct file *filp, poll_table *wait)
 
 	poll_wait(filp, &pipe->wake_queue, wait);
 
-	spin_lock_irqsave(&dev->lock, irq_flags);
-	writel((unsigned long)pipe, dev->base + PIPE_REG_CHANNEL);
-	writel(CMD_POLL, dev->base + PIPE_REG_COMMAND);
-	status = readl(dev->base + PIPE_REG_STATUS);
-	spin_unlock_irqrestore(&dev->lock, irq_flags);
+	status = qemu_pipe_command(pipe, CMD_POLL, 0);
 
 	mutex_unlock(&pipe->lock);
 
@@ -445,9 +976,59 @@ static unsigned int qemu_pipe_poll(struct file *filp, poll_table *wait)
 	return mask;
 }
 
-static irqreturn_t qemu_pipe_interrupt(int irq, void *dev_id)
+/* Apply a set of PIPE_WAKE_* flags received from the emulator */
+static void qemu_pipe_wake(struct qemu_pipe *pipe, unsigned long wakes)
+{
+	/* Did the emulator just closed a pipe? */
+	if (wakes & PIPE_WAKE_CLOSED) {
+		set_bit(BIT_CLOSED_ON_HOST, &pipe->flags);
+		wakes |= PIPE_WAKE_READ | PIPE_WAKE_WRITE;
+	}
+	if (wakes & PIPE_WAKE_READ)
+		clear_bit(BIT_WAKE_ON_READ, &pipe->flags);
+	if (wakes & PIPE_WAKE_WRITE)
+		clear_bit(BIT_WAKE_ON_WRITE, &pipe->flags);
+
+	wake_up_interruptible(&pipe->wake_queue);
+}
+
+/* Multi-queue interrupt handling: consume the shared wake area without
+ * taking dev->lock. Channels are looked up under RCU, see
+ * qemu_pipe_release().
+ */
+static int qemu_pipe_interrupt_mq(struct qemu_pipe_dev *dev)
+{
+	struct pipe_wake_area *area = dev->wake_area;
+	int count = 0;
+	int i;
+
+	rcu_read_lock();
+	for (i = 0; i < BITS_TO_LONGS(PIPE_MQ_MAX_CHANNELS); i++) {
+		unsigned long pending = xchg(&area->mask[i], 0);
+
+		while (pending) {
+			int bit = __ffs(pending);
+			int id = i * BITS_PER_LONG + bit;
+			unsigned long wakes = xchg(&area->flags[id], 0);
+			struct qemu_pipe *pipe;
+
+			pending &= ~(1UL << bit);
+			pipe = rcu_dereference(dev->channels[id]);
+			if (pipe != NULL && wakes != 0)
+				qemu_pipe_wake(pipe, wakes);
+			count++;
+		}
+	}
+	rcu_read_unlock();
+
+	return count;
+}
+
+/* Legacy interrupt handling, also used in multi-queue mode for channels
+ * that did not get a wake area index.
+ */
+static int qemu_pipe_interrupt_legacy(struct qemu_pipe_dev *dev)
 {
-	struct qemu_pipe_dev *dev = dev_id;
 	unsigned long irq_flags;
 	int count = 0;
 
@@ -469,27 +1050,57 @@ static irqreturn_t qemu_pipe_interrupt(int irq, void *dev_id)
 		wakes = readl(dev->base + PIPE_REG_WAKES);
 		pipe  = (struct qemu_pipe *)(ptrdiff_t)channel;
 
-		/* Did the emulator just closed a pipe? */
-		if (wakes & PIPE_WAKE_CLOSED) {
-			set_bit(BIT_CLOSED_ON_HOST, &pipe->flags);
-			wakes |= PIPE_WAKE_READ | PIPE_WAKE_WRITE;
-		}
-		if (wakes & PIPE_WAKE_READ)
-			clear_bit(BIT_WAKE_ON_READ, &pipe->flags);
-		if (wakes & PIPE_WAKE_WRITE)
-			clear_bit(BIT_WAKE_ON_WRITE, &pipe->flags);
-
-		wake_up_interruptible(&pipe->wake_queue);
+		qemu_pipe_wake(pipe, wakes);
 		count++;
 	}
 	spin_unlock_irqrestore(&dev->lock, irq_flags);
 
+	return count;
+}
+
+static irqreturn_t qemu_pipe_interrupt(int irq, void *dev_id)
+{
+	struct qemu_pipe_dev *dev = dev_id;
+	int count = 0;
+
+	if (dev->multiqueue) {
+		count = qemu_pipe_interrupt_mq(dev);
+		if (atomic_read(&dev->legacy_channels) == 0)
+			return (count == 0) ? IRQ_NONE : IRQ_HANDLED;
+	}
+
+	count += qemu_pipe_interrupt_legacy(dev);
 	return (count == 0) ? IRQ_NONE : IRQ_HANDLED;
 }
 
+/* Reserve a wake area index for a new channel in multi-queue mode */
+static int qemu_pipe_alloc_id(struct qemu_pipe_dev *dev)
+{
+	int id;
+
+	do {
+		id = find_first_zero_bit(dev->channel_map,
+					 PIPE_MQ_MAX_CHANNELS);
+		if (id >= PIPE_MQ_MAX_CHANNELS)
+			return -ENOSPC;
+	} while (test_and_set_bit(id, dev->channel_map));
+
+	dev->wake_area->flags[id] = 0;
+	return id;
+}
+
+/* Give back a wake area index, dropping any wake still pending for it so
+ * the next channel using the index doesn't get it.
+ */
+static void qemu_pipe_free_id(struct qemu_pipe_dev *dev, int id)
+{
+	clear_bit(id, dev->wake_area->mask);
+	dev->wake_area->flags[id] = 0;
+	clear_bit(id, dev->channel_map);
+}
+
 static int qemu_pipe_open(struct inode *inode, struct file *file)
 {
-	unsigned long irq_flags;
 	struct qemu_pipe *pipe;
 	struct qemu_pipe_dev *dev = pipe_dev;
 	int32_t status;
@@ -507,17 +1118,33 @@ static int qemu_pipe_open(struct inode *inode, struct file *file)
 	mutex_init(&pipe->lock);
 	init_waitqueue_head(&pipe->wake_queue);
 
+	pipe->id = -1;
+	if (dev->multiqueue) {
+		pipe->id = qemu_pipe_alloc_id(dev);
+		if (pipe->id >= 0)
+			rcu_assign_pointer(dev->channels[pipe->id], pipe);
+		else {
+			/* wake area full, fall back to the wake registers */
+			PIPE_D("No wake slot left, using legacy wakes\n");
+			pipe->id = -1;
+			atomic_inc(&dev->legacy_channels);
+		}
+	}
+
 	/* Now, tell the emulator we're opening a new pipe. We use the
 	* pipe object's address as the channel identifier for simplicity.
+	* In multi-queue mode, it also learns the channel's wake area index.
 	*/
-	spin_lock_irqsave(&dev->lock, irq_flags);
-	writel((unsigned long)pipe, dev->base + PIPE_REG_CHANNEL);
-	writel(CMD_OPEN, dev->base + PIPE_REG_COMMAND);
-	status = readl(dev->base + PIPE_REG_STATUS);
-	spin_unlock_irqrestore(&dev->lock, irq_flags);
+	status = qemu_pipe_command(pipe, CMD_OPEN, pipe->id + 1);
 
 	if (status < 0) {
 		PIPE_D("Could not open pipe channel, error=%d\n", status);
+		if (pipe->id >= 0) {
+			rcu_assign_pointer(dev->channels[pipe->id], NULL);
+			synchronize_rcu();
+			qemu_pipe_free_id(dev, pipe->id);
+		} else if (dev->multiqueue)
+			atomic_dec(&dev->legacy_channels);
 		kfree(pipe);
 		return status;
 	}
@@ -527,22 +1154,45 @@ static int qemu_pipe_open(struct inode *inode, struct file *file)
 	return 0;
 }
 
+static void qemu_pipe_free(struct qemu_pipe *pipe)
+{
+	qemu_pipe_free_ring(pipe);
+	if (pipe->descs)
+		free_page((unsigned long)pipe->descs);
+	kfree(pipe->pages);
+	kfree(pipe);
+}
+
+/* The interrupt handler may still be looking at a multi-queue channel, so
+ * its index and memory are only released after a grace period.
+ */
+static void qemu_pipe_free_rcu(struct rcu_head *head)
+{
+	struct qemu_pipe *pipe = container_of(head, struct qemu_pipe, rcu);
+
+	qemu_pipe_free_id(pipe->dev, pipe->id);
+	qemu_pipe_free(pipe);
+}
+
 static int qemu_pipe_release(struct inode *inode, struct file *filp)
 {
-	unsigned long irq_flags;
 	struct qemu_pipe *pipe = filp->private_data;
 	struct qemu_pipe_dev *dev = pipe->dev;
 
 	PIPE_D("Closing pipe %p\n", dev);
 
 	/* The guest is closing the channel, so tell the emulator right now */
-	spin_lock_irqsave(&dev->lock, irq_flags);
-	writel((unsigned long)pipe, dev->base + PIPE_REG_CHANNEL);
-	writel(CMD_CLOSE, dev->base + PIPE_REG_COMMAND);
-	spin_unlock_irqrestore(&dev->lock, irq_flags);
+	qemu_pipe_command(pipe, CMD_CLOSE, 0);
 
-	kfree(pipe);
 	filp->private_data = NULL;
+	if (pipe->id >= 0) {
+		rcu_assign_pointer(dev->channels[pipe->id], NULL);
+		call_rcu(&pipe->rcu, qemu_pipe_free_rcu);
+	} else {
+		if (dev->multiqueue)
+			atomic_dec(&dev->legacy_channels);
+		qemu_pipe_free(pipe);
+	}
 	return 0;
 }
 
@@ -551,6 +1201,8 @@ static const struct file_operations qemu_pipe_fops = {
 	.read = qemu_pipe_read,
 	.write = qemu_pipe_write,
 	.poll = qemu_pipe_poll,
+	.unlocked_ioctl = qemu_pipe_ioctl,
+	.mmap = qemu_pipe_mmap,
 	.open = qemu_pipe_open,
 	.release = qemu_pipe_release,
 };
@@ -598,14 +1250,20 @@ static int qemu_pipe_probe(struct platform_device *pdev)
 
 	spin_lock_init(&dev->lock);
 
+	/* the device must be fully set up before userspace can open it */
+	setup_access_params_addr(dev);
+	dev->version = readl(dev->base + PIPE_REG_VERSION);
+	PIPE_D("Device version is %d\n", dev->version);
+	if (setup_multiqueue(dev) == 0)
+		PIPE_D("Multi-queue mode enabled\n");
+
 	err = misc_register(&qemu_pipe_device);
 	if (err)
 		goto err_misc_register;
-
-	setup_access_params_addr(dev);
 	return 0;
 
 err_misc_register:
+	teardown_multiqueue(dev);
 	free_irq(dev->irq, pdev);
 err_alloc_irq:
 	iounmap(dev->base);
@@ -622,6 +1280,7 @@ static int qemu_pipe_remove(struct platform_device *pdev)
 
 	free_irq(dev->irq, pdev);
 
+	teardown_multiqueue(dev);
 	iounmap(dev->base);
 	if (dev->aps)
 		kfree(dev->aps);
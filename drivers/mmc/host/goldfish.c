@@ -60,6 +60,19 @@
 
 #define BUFFER_SIZE   16384
 
+/* Descriptor list used when the emulator can access the scatterlist
+ * directly (MMC_CAP_DESC_DMA). It lives right after the bounce buffer
+ * in the same coherent allocation.
+ */
+struct goldfish_mmc_desc {
+	u32 addr;	/* bus address of the segment */
+	u32 len;	/* length of the segment in bytes */
+};
+
+#define MAX_DESCS       128
+#define DESC_LIST_SIZE  (MAX_DESCS * sizeof(struct goldfish_mmc_desc))
+#define DMA_AREA_SIZE   (BUFFER_SIZE + DESC_LIST_SIZE)
+
 #define GOLDFISH_MMC_READ(host, addr)   (readl(host->reg_base + addr))
 #define GOLDFISH_MMC_WRITE(host, addr, x)   (writel(x, host->reg_base + addr))
 
@@ -96,6 +109,15 @@ enum {
 	/* MMC state flags */
 	MMC_STATE               = 0x2C,
 
+	/* host capabilities, reads as 0 on older emulators */
+	MMC_CAPS                = 0x30,
+
+	/* physical address of the descriptor list */
+	MMC_SET_DESC_LIST       = 0x34,
+
+	/* number of descriptors for the next data command */
+	MMC_DESC_COUNT          = 0x38,
+
 	/* MMC_INT_STATUS bits */
 	
 	MMC_STAT_END_OF_CMD     = 1U << 0,
@@ -106,6 +128,9 @@ enum {
 	/* MMC_STATE bits */
 	MMC_STATE_INSERTED     = 1U << 0,
 	MMC_STATE_READ_ONLY    = 1U << 1,
+
+	/* MMC_CAPS bits */
+	MMC_CAP_DESC_DMA       = 1U << 0,
 };
 
 /*
@@ -133,6 +158,8 @@ struct goldfish_mmc_host {
 	unsigned int		sg_len;
 	unsigned		dma_done:1;
 	unsigned		dma_in_use:1;
+	unsigned		desc_dma:1;
+	struct goldfish_mmc_desc *descs;
 
 	void __iomem		*reg_base;
 };
@@ -223,13 +250,14 @@ goldfish_mmc_xfer_done(struct goldfish_mmc_host *host, struct mmc_data *data)
 		else
 			dma_data_dir = DMA_FROM_DEVICE;
 
-		if (dma_data_dir == DMA_FROM_DEVICE) {
+		if (dma_data_dir == DMA_FROM_DEVICE && !host->desc_dma) {
 			// we don't really have DMA, so we need to copy from our platform driver buffer
-			uint8_t* dest = (uint8_t *)sg_virt(data->sg);
-			memcpy(dest, host->virt_base, data->sg->length);
+			sg_copy_from_buffer(data->sg, data->sg_len,
+					    host->virt_base,
+					    data->blocks * data->blksz);
 		}
 
-		host->data->bytes_xfered += data->sg->length;
+		host->data->bytes_xfered += data->blocks * data->blksz;
 
 		dma_unmap_sg(mmc_dev(host->mmc), data->sg, host->sg_len, dma_data_dir);
 	}
@@ -380,7 +408,7 @@ goldfish_mmc_prepare_data(struct goldfish_mmc_host *host, struct mmc_request *re
 	/* cope with calling layer confusion; it issues "single
 	 * block" writes using multi-block scatterlists.
 	 */
-	sg_len = (data->blocks == 1) ? 1 : data->sg_len;
+	sg_len = (data->blocks == 1 && !host->desc_dma) ? 1 : data->sg_len;
 
 	if (data->flags & MMC_DATA_WRITE)
 		dma_data_dir = DMA_TO_DEVICE;
@@ -400,11 +428,27 @@ goldfish_mmc_prepare_data(struct goldfish_mmc_host *host, struct mmc_request *re
 #endif
 	host->dma_done = 0;
 	host->dma_in_use = 1;
-	
-	if (dma_data_dir == DMA_TO_DEVICE) {
+
+	if (host->desc_dma) {
+		/* the emulator reads/writes the segments directly */
+		struct scatterlist *sg;
+		unsigned remain = data->blocks * data->blksz;
+		unsigned count = 0;
+		int i;
+
+		for_each_sg(data->sg, sg, host->sg_len, i) {
+			if (remain == 0)
+				break;
+			host->descs[count].addr = sg_dma_address(sg);
+			host->descs[count].len = min(sg_dma_len(sg), remain);
+			remain -= host->descs[count].len;
+			count++;
+		}
+		GOLDFISH_MMC_WRITE(host, MMC_DESC_COUNT, count);
+	} else if (dma_data_dir == DMA_TO_DEVICE) {
 		// we don't really have DMA, so we need to copy to our platform driver buffer
-		const uint8_t* src = (uint8_t *)sg_virt(data->sg);
-		memcpy(host->virt_base, src, data->sg->length);
+		sg_copy_to_buffer(data->sg, data->sg_len, host->virt_base,
+				  data->blocks * data->blksz);
 	}
 }
 
@@ -472,14 +516,14 @@ static int __init goldfish_mmc_probe(struct platform_device *pdev)
 	host->mmc = mmc;	
 #if defined(CONFIG_ARM)
 	host->reg_base = (void __iomem *)IO_ADDRESS(res->start - IO_START);
-	host->virt_base = dma_alloc_writecombine(&pdev->dev, BUFFER_SIZE,
+	host->virt_base = dma_alloc_writecombine(&pdev->dev, DMA_AREA_SIZE,
 						 &buf_addr, GFP_KERNEL);
 #elif defined(CONFIG_X86) || defined(CONFIG_MIPS)
     /*
      * Use NULL for dev for ISA-like devices
      */
 	host->reg_base = ioremap(res->start, res->end - res->start + 1);
-	host->virt_base = dma_alloc_coherent(NULL, BUFFER_SIZE, &buf_addr, GFP_KERNEL);
+	host->virt_base = dma_alloc_coherent(NULL, DMA_AREA_SIZE, &buf_addr, GFP_KERNEL);
 #else
 #error NOT SUPPORTED
 #endif
@@ -488,6 +532,7 @@ static int __init goldfish_mmc_probe(struct platform_device *pdev)
 		goto dma_alloc_failed;
 	}
 	host->phys_base = buf_addr;
+	host->descs = host->virt_base + BUFFER_SIZE;
 
 	host->id = pdev->id;
 	host->irq = irq;
@@ -509,6 +554,17 @@ static int __init goldfish_mmc_probe(struct platform_device *pdev)
 	mmc->max_req_size = BUFFER_SIZE;
 	mmc->max_seg_size = mmc->max_req_size;
 
+	/* Without the bounce buffer, requests are only limited by the
+	 * block count register and the descriptor list size.
+	 */
+	if (GOLDFISH_MMC_READ(host, MMC_CAPS) & MMC_CAP_DESC_DMA) {
+		host->desc_dma = 1;
+		mmc->max_phys_segs = MAX_DESCS;
+		mmc->max_hw_segs = MAX_DESCS;
+		mmc->max_req_size = 512 * mmc->max_blk_count;
+		mmc->max_seg_size = mmc->max_req_size;
+	}
+
 	ret = request_irq(host->irq, goldfish_mmc_irq, 0, DRIVER_NAME, host);
 	if (ret)
 		goto err_request_irq_failed;
@@ -521,6 +577,9 @@ static int __init goldfish_mmc_probe(struct platform_device *pdev)
 		dev_warn(mmc_dev(host->mmc), "Unable to create sysfs attributes\n");
 
 	GOLDFISH_MMC_WRITE(host, MMC_SET_BUFFER, host->phys_base);	
+	if (host->desc_dma)
+		GOLDFISH_MMC_WRITE(host, MMC_SET_DESC_LIST,
+				   host->phys_base + BUFFER_SIZE);
 	GOLDFISH_MMC_WRITE(host, MMC_INT_ENABLE, 
 		MMC_STAT_END_OF_CMD | MMC_STAT_END_OF_DATA | MMC_STAT_STATE_CHANGE |
 		MMC_STAT_CMD_TIMEOUT);
@@ -531,9 +590,9 @@ static int __init goldfish_mmc_probe(struct platform_device *pdev)
 
 err_request_irq_failed:
 #if defined(CONFIG_ARM)
-	dma_free_writecombine(&pdev->dev, BUFFER_SIZE, host->virt_base, host->phys_base);
+	dma_free_writecombine(&pdev->dev, DMA_AREA_SIZE, host->virt_base, host->phys_base);
 #elif defined(CONFIG_X86) || defined(CONFIG_MIPS)
-	dma_free_coherent(NULL, BUFFER_SIZE, host->virt_base, host->phys_base);
+	dma_free_coherent(NULL, DMA_AREA_SIZE, host->virt_base, host->phys_base);
 #else
 #error NOT SUPPORTED
 #endif
@@ -554,9 +613,9 @@ static int goldfish_mmc_remove(struct platform_device *pdev)
 	mmc_remove_host(host->mmc);
 	free_irq(host->irq, host);
 #if defined(CONFIG_ARM)
-	dma_free_writecombine(&pdev->dev, BUFFER_SIZE, host->virt_base, host->phys_base);
+	dma_free_writecombine(&pdev->dev, DMA_AREA_SIZE, host->virt_base, host->phys_base);
 #elif defined(CONFIG_X86) || defined(CONFIG_MIPS)
-	dma_free_coherent(NULL, BUFFER_SIZE, host->virt_base, host->phys_base);
+	dma_free_coherent(NULL, DMA_AREA_SIZE, host->virt_base, host->phys_base);
 #else
 #error NOT SUPPORTED
 #endif
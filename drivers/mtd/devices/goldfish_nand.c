@@ -23,17 +23,133 @@
 #include <linux/mtd/compatmac.h>
 #include <linux/mtd/mtd.h>
 #include <linux/platform_device.h>
+#include <linux/interrupt.h>
+#include <linux/completion.h>
+#include <linux/semaphore.h>
+#include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/device.h>
 
 #include "goldfish_nand_reg.h"
 
+#define NAND_RING_ENTRIES 32
+
+/* Guest side state of a command ring entry */
+struct goldfish_nand_slot {
+	struct completion       done;
+	int                     waiting;
+};
+
 struct goldfish_nand {
 	spinlock_t              lock;
 	unsigned char __iomem  *base;
 	struct cmd_params       *cmd_params;
+
+	/* Command ring, NULL if the emulator doesn't provide one. ring_lock
+	 * only protects entry allocation and completion, never register
+	 * accesses. */
+	struct nand_ring_entry  *ring;
+	struct goldfish_nand_slot *slots;
+	spinlock_t              ring_lock;
+	struct semaphore        ring_free;
+	unsigned int            ring_next;
+	int                     irq;
+
+	/* Per device page caches, NULL unless cache_pages is set */
+	struct goldfish_nand_cache **caches;
+
 	size_t                  mtd_count;
 	struct mtd_info         mtd[0];
 };
 
+/* Queue a command on the ring and sleep until the emulator completes it.
+ * Returns the number of data bytes transferred, and the number of oob bytes
+ * in *oob_result when oob_result is not NULL.
+ */
+static uint32_t goldfish_nand_ring_cmd(struct mtd_info *mtd,
+			enum nand_cmd cmd, uint64_t addr, uint32_t pages,
+			uint32_t data_size, void *data, uint32_t oob_offset,
+			uint32_t oob_size, void *oob, uint32_t *oob_result)
+{
+	struct goldfish_nand *nand = mtd->priv;
+	struct nand_ring_entry *e;
+	struct goldfish_nand_slot *slot;
+	unsigned long irq_flags;
+	unsigned int i;
+	int wait = 0;
+	uint32_t rv;
+
+	down(&nand->ring_free);
+
+	spin_lock_irqsave(&nand->ring_lock, irq_flags);
+	i = nand->ring_next;
+	while (nand->ring[i].state != NAND_RING_ENTRY_FREE)
+		i = (i + 1) % NAND_RING_ENTRIES;
+	nand->ring_next = (i + 1) % NAND_RING_ENTRIES;
+	e = &nand->ring[i];
+	slot = &nand->slots[i];
+	e->cmd = cmd;
+	e->dev = mtd - nand->mtd;
+	e->addr_high = (uint32_t)(addr >> 32);
+	e->addr_low = (uint32_t)addr;
+	e->pages = pages;
+	e->data_size = data_size;
+	e->data = (uint32_t)data;
+	e->oob_offset = oob_offset;
+	e->oob_size = oob_size;
+	e->oob = (uint32_t)oob;
+	e->result = 0;
+	e->oob_result = 0;
+	slot->waiting = 0;
+	INIT_COMPLETION(slot->done);
+	wmb();
+	e->state = NAND_RING_ENTRY_SUBMITTED;
+	spin_unlock_irqrestore(&nand->ring_lock, irq_flags);
+
+	writel(i, nand->base + NAND_RING_DOORBELL);
+
+	/* The emulator usually completes the entry before the doorbell write
+	 * returns, in which case there is nothing to wait for. */
+	spin_lock_irqsave(&nand->ring_lock, irq_flags);
+	if (e->state != NAND_RING_ENTRY_DONE)
+		slot->waiting = wait = 1;
+	spin_unlock_irqrestore(&nand->ring_lock, irq_flags);
+	if (wait)
+		wait_for_completion(&slot->done);
+
+	rmb();
+	rv = e->result;
+	if (oob_result)
+		*oob_result = e->oob_result;
+
+	spin_lock_irqsave(&nand->ring_lock, irq_flags);
+	e->state = NAND_RING_ENTRY_FREE;
+	spin_unlock_irqrestore(&nand->ring_lock, irq_flags);
+	up(&nand->ring_free);
+	return rv;
+}
+
+static irqreturn_t goldfish_nand_interrupt(int irq, void *dev_id)
+{
+	struct goldfish_nand *nand = dev_id;
+	unsigned long irq_flags;
+	int i;
+
+	if (!readl(nand->base + NAND_IRQ_STATUS))
+		return IRQ_NONE;
+
+	spin_lock_irqsave(&nand->ring_lock, irq_flags);
+	for (i = 0; i < NAND_RING_ENTRIES; i++) {
+		if (nand->slots[i].waiting &&
+		    nand->ring[i].state == NAND_RING_ENTRY_DONE) {
+			nand->slots[i].waiting = 0;
+			complete(&nand->slots[i].done);
+		}
+	}
+	spin_unlock_irqrestore(&nand->ring_lock, irq_flags);
+	return IRQ_HANDLED;
+}
+
 static uint32_t goldfish_nand_cmd_with_params(struct mtd_info *mtd,
 			enum nand_cmd cmd, uint64_t addr, uint32_t len,
 			void *ptr, uint32_t *rv)
@@ -77,6 +193,11 @@ static uint32_t goldfish_nand_cmd(struct mtd_info *mtd, enum nand_cmd cmd,
 	unsigned long irq_flags;
 	unsigned char __iomem  *base = nand->base;
 
+	if (nand->ring && (cmd == NAND_CMD_READ || cmd == NAND_CMD_WRITE ||
+	                   cmd == NAND_CMD_ERASE))
+		return goldfish_nand_ring_cmd(mtd, cmd, addr, 1, len, ptr,
+		                              0, 0, NULL, NULL);
+
 	spin_lock_irqsave(&nand->lock, irq_flags);
 	if (goldfish_nand_cmd_with_params(mtd, cmd, addr, len, ptr, &rv))
 	{
@@ -92,11 +213,433 @@ static uint32_t goldfish_nand_cmd(struct mtd_info *mtd, enum nand_cmd cmd,
 	return rv;
 }
 
+static inline int goldfish_nand_has_ring(struct mtd_info *mtd)
+{
+	struct goldfish_nand *nand = mtd->priv;
+	return nand->ring != NULL;
+}
+
+/* Whole pages only; more than one at a time needs the command ring */
+static int goldfish_nand_valid_len(struct mtd_info *mtd, size_t len)
+{
+	if(len == mtd->writesize)
+		return 1;
+	return goldfish_nand_has_ring(mtd) && len &&
+	       len % mtd->writesize == 0;
+}
+
+/* Optional page cache, enabled with the cache_pages module parameter.
+ *
+ * Each entry holds one raw page (data followed by the whole extra area),
+ * keyed by its raw emulator address. Read misses fill the cache with a
+ * multi-page command, reading ahead when accesses are sequential, which
+ * mostly helps the repeated oob tag reads of YAFFS2 mounts and scans.
+ *
+ * Full-page writes (data and whole oob) are also gathered in a batch of
+ * consecutive pages and sent as a single multi-page command. The batch is
+ * flushed before any read miss, erase, bad block update or mtd->sync, and
+ * when a non-consecutive or partial write comes in. A failed batch is
+ * reported by the next write, erase or bad block update on the device.
+ */
+static int cache_pages;
+module_param(cache_pages, int, S_IRUGO);
+MODULE_PARM_DESC(cache_pages, "Pages cached per NAND device (0 = no cache)");
+
+static int readahead_pages = 8;
+module_param(readahead_pages, int, S_IRUGO);
+MODULE_PARM_DESC(readahead_pages, "Pages read ahead on sequential misses");
+
+static int write_batch = 8;
+module_param(write_batch, int, S_IRUGO);
+MODULE_PARM_DESC(write_batch, "Consecutive page writes sent as one command");
+
+#define NAND_CACHE_HASH_SIZE 64
+
+struct goldfish_nand_cache_entry {
+	struct hlist_node       hash;
+	struct list_head        lru;
+	uint64_t                addr;
+	int                     valid;
+	u_char                 *buf;
+};
+
+struct goldfish_nand_cache {
+	struct mutex            lock;
+	uint32_t                stride;      /* writesize + oobsize */
+	uint64_t                raw_size;
+	struct goldfish_nand_cache_entry *entries;
+	u_char                 *buf;
+	struct hlist_head       hash[NAND_CACHE_HASH_SIZE];
+	struct list_head        lru;         /* most recently used first */
+	uint64_t                next_addr;   /* expected next sequential miss */
+
+	/* readahead and write batch buffers, max_pages raw pages each */
+	uint32_t                max_pages;
+	u_char                 *ra_data, *ra_oob;
+	u_char                 *wb_data, *wb_oob;
+	uint64_t                wb_start;
+	uint32_t                wb_count;
+	uint32_t                wb_max;
+	int                     wb_error;    /* failed batch not yet reported */
+
+	unsigned long           hits, misses, readahead;
+	unsigned long           writes_batched, flushes;
+};
+
+static inline struct goldfish_nand_cache *goldfish_nand_get_cache(
+	struct mtd_info *mtd)
+{
+	struct goldfish_nand *nand = mtd->priv;
+	return nand->caches ? nand->caches[mtd - nand->mtd] : NULL;
+}
+
+static struct goldfish_nand_cache_entry *nand_cache_lookup(
+	struct goldfish_nand_cache *c, uint64_t addr)
+{
+	struct goldfish_nand_cache_entry *e;
+	struct hlist_node *n;
+	uint64_t page = addr;
+
+	do_div(page, c->stride);
+	hlist_for_each_entry(e, n, &c->hash[page % NAND_CACHE_HASH_SIZE],
+	                     hash) {
+		if (e->addr == addr) {
+			list_move(&e->lru, &c->lru);
+			return e;
+		}
+	}
+	return NULL;
+}
+
+static void nand_cache_invalidate(struct goldfish_nand_cache *c,
+                                  uint64_t addr)
+{
+	struct goldfish_nand_cache_entry *e = nand_cache_lookup(c, addr);
+
+	if (e) {
+		hlist_del(&e->hash);
+		e->valid = 0;
+		list_move_tail(&e->lru, &c->lru);
+	}
+}
+
+/* Store a raw page, recycling the least recently used entry if needed */
+static void nand_cache_insert(struct goldfish_nand_cache *c, uint64_t addr,
+                              const u_char *data, const u_char *oob,
+                              uint32_t writesize)
+{
+	struct goldfish_nand_cache_entry *e = nand_cache_lookup(c, addr);
+	uint64_t page = addr;
+
+	if (e == NULL) {
+		e = list_entry(c->lru.prev, struct goldfish_nand_cache_entry,
+		               lru);
+		if (e->valid)
+			hlist_del(&e->hash);
+		do_div(page, c->stride);
+		e->addr = addr;
+		e->valid = 1;
+		hlist_add_head(&e->hash,
+		               &c->hash[page % NAND_CACHE_HASH_SIZE]);
+		list_move(&e->lru, &c->lru);
+	}
+	memcpy(e->buf, data, writesize);
+	memcpy(e->buf + writesize, oob, c->stride - writesize);
+}
+
+/* Read 'pages' raw pages into separate data and oob buffers */
+static int nand_read_raw_pages(struct mtd_info *mtd, uint64_t addr,
+                               uint32_t pages, u_char *data, u_char *oob)
+{
+	uint32_t oob_result, i;
+
+	if (goldfish_nand_has_ring(mtd)) {
+		if (goldfish_nand_ring_cmd(mtd, NAND_CMD_READ, addr, pages,
+		                mtd->writesize, data, 0, mtd->oobsize, oob,
+		                &oob_result) != pages * mtd->writesize ||
+		    oob_result != pages * mtd->oobsize)
+			return -EIO;
+		return 0;
+	}
+
+	for (i = 0; i < pages; i++) {
+		uint64_t ofs = addr + i * (mtd->writesize + mtd->oobsize);
+		if (goldfish_nand_cmd(mtd, NAND_CMD_READ, ofs, mtd->writesize,
+		                      data + i * mtd->writesize) != mtd->writesize ||
+		    goldfish_nand_cmd(mtd, NAND_CMD_READ, ofs + mtd->writesize,
+		                      mtd->oobsize, oob + i * mtd->oobsize) !=
+		    mtd->oobsize)
+			return -EIO;
+	}
+	return 0;
+}
+
+/* Called with c->lock held. The callers of the batched writes have already
+ * been told they succeeded, so a failure is kept in wb_error and returned
+ * by nand_cache_error() to the next write type operation.
+ */
+static void nand_cache_flush(struct mtd_info *mtd,
+                             struct goldfish_nand_cache *c)
+{
+	uint32_t oob_result, count = c->wb_count;
+
+	if (count == 0)
+		return;
+	c->wb_count = 0;
+	c->flushes++;
+
+	if (goldfish_nand_ring_cmd(mtd, NAND_CMD_WRITE, c->wb_start, count,
+	                mtd->writesize, c->wb_data, 0, mtd->oobsize,
+	                c->wb_oob, &oob_result) != count * mtd->writesize ||
+	    oob_result != count * mtd->oobsize) {
+		printk("goldfish_nand: %s: batched write of %d pages at %llx "
+		       "failed\n", mtd->name, count, c->wb_start);
+		c->wb_error = -EIO;
+	}
+}
+
+/* Called with c->lock held */
+static int nand_cache_error(struct goldfish_nand_cache *c)
+{
+	int err = c->wb_error;
+
+	c->wb_error = 0;
+	return err;
+}
+
+/* Read whole pages through the cache. Always handles the request. */
+static int nand_cache_read(struct mtd_info *mtd, uint64_t addr,
+                           uint32_t pages, u_char *data,
+                           uint32_t oob_offset, uint32_t oob_len,
+                           u_char *oob, size_t *retlen, size_t *oobretlen)
+{
+	struct goldfish_nand_cache *c = goldfish_nand_get_cache(mtd);
+	struct goldfish_nand_cache_entry *e;
+	uint32_t i;
+	int ret = 0;
+
+	mutex_lock(&c->lock);
+	for (i = 0; i < pages; i++, addr += c->stride) {
+		e = nand_cache_lookup(c, addr);
+		if (e) {
+			c->hits++;
+		} else {
+			uint32_t n = pages - i, j;
+
+			c->misses++;
+			nand_cache_flush(mtd, c);
+			if (addr == c->next_addr && n < readahead_pages)
+				n = readahead_pages;
+			if (n > c->max_pages)
+				n = c->max_pages;
+			while (n > 1 && addr + (uint64_t)n * c->stride >
+			                c->raw_size)
+				n--;
+
+			ret = nand_read_raw_pages(mtd, addr, n, c->ra_data,
+			                          c->ra_oob);
+			if (ret)
+				break;
+			if (n > pages - i)
+				c->readahead += n - (pages - i);
+			for (j = 0; j < n; j++)
+				nand_cache_insert(c, addr + j * c->stride,
+				                  c->ra_data + j * mtd->writesize,
+				                  c->ra_oob + j * mtd->oobsize,
+				                  mtd->writesize);
+			c->next_addr = addr + n * c->stride;
+			e = nand_cache_lookup(c, addr);
+		}
+
+		if (data) {
+			memcpy(data + i * mtd->writesize, e->buf,
+			       mtd->writesize);
+			*retlen += mtd->writesize;
+		}
+		if (oob) {
+			memcpy(oob, e->buf + mtd->writesize + oob_offset,
+			       oob_len);
+			*oobretlen += oob_len;
+		}
+	}
+	mutex_unlock(&c->lock);
+	return ret;
+}
+
+/* Queue a full page write in the write batch. Returns 1 if the page can't
+ * be batched, in which case pending writes have been flushed and the cached
+ * copy dropped, and the caller must write it out itself. Returns a negative
+ * error if an earlier batched write failed.
+ */
+static int nand_cache_write(struct mtd_info *mtd, uint64_t addr,
+                            const u_char *data, uint32_t oob_offset,
+                            uint32_t oob_len, const u_char *oob)
+{
+	struct goldfish_nand_cache *c = goldfish_nand_get_cache(mtd);
+	int ret = 0;
+
+	mutex_lock(&c->lock);
+	if (c->wb_max < 2 || !data || !oob || oob_offset != 0 ||
+	    oob_len != mtd->oobsize) {
+		nand_cache_flush(mtd, c);
+		nand_cache_invalidate(c, addr);
+		ret = nand_cache_error(c);
+		mutex_unlock(&c->lock);
+		return ret ? ret : 1;
+	}
+
+	if (c->wb_count && (c->wb_count == c->wb_max ||
+	                    addr != c->wb_start + c->wb_count * c->stride))
+		nand_cache_flush(mtd, c);
+	if (c->wb_count == 0)
+		c->wb_start = addr;
+	memcpy(c->wb_data + c->wb_count * mtd->writesize, data,
+	       mtd->writesize);
+	memcpy(c->wb_oob + c->wb_count * mtd->oobsize, oob, mtd->oobsize);
+	c->wb_count++;
+	c->writes_batched++;
+	nand_cache_insert(c, addr, data, oob, mtd->writesize);
+	ret = nand_cache_error(c);
+	mutex_unlock(&c->lock);
+	return ret;
+}
+
+/* Flush pending writes and drop cached pages in [addr, addr + len), before
+ * an erase or an unbatched write of that range */
+static int nand_cache_discard(struct mtd_info *mtd, uint64_t addr,
+                              uint64_t len)
+{
+	struct goldfish_nand_cache *c = goldfish_nand_get_cache(mtd);
+	uint64_t end = addr + len;
+	int ret;
+
+	mutex_lock(&c->lock);
+	nand_cache_flush(mtd, c);
+	for (; addr < end; addr += c->stride)
+		nand_cache_invalidate(c, addr);
+	ret = nand_cache_error(c);
+	mutex_unlock(&c->lock);
+	return ret;
+}
+
+static int nand_cache_sync(struct mtd_info *mtd)
+{
+	struct goldfish_nand_cache *c = goldfish_nand_get_cache(mtd);
+	int ret = 0;
+
+	if (c) {
+		mutex_lock(&c->lock);
+		nand_cache_flush(mtd, c);
+		ret = nand_cache_error(c);
+		mutex_unlock(&c->lock);
+	}
+	return ret;
+}
+
+/* mtd->sync can't return an error, so a failed flush stays pending for the
+ * next write type operation */
+static void goldfish_nand_sync(struct mtd_info *mtd)
+{
+	struct goldfish_nand_cache *c = goldfish_nand_get_cache(mtd);
+
+	if (c) {
+		mutex_lock(&c->lock);
+		nand_cache_flush(mtd, c);
+		mutex_unlock(&c->lock);
+	}
+}
+
+static void nand_free_cache(struct goldfish_nand_cache *c)
+{
+	if (c == NULL)
+		return;
+	vfree(c->buf);
+	kfree(c->entries);
+	kfree(c->ra_data);
+	kfree(c->ra_oob);
+	kfree(c->wb_data);
+	kfree(c->wb_oob);
+	kfree(c);
+}
+
+static struct goldfish_nand_cache *nand_alloc_cache(struct mtd_info *mtd)
+{
+	struct goldfish_nand_cache *c;
+	uint32_t max_pages;
+	int i;
+
+	max_pages = max(readahead_pages, write_batch);
+	if (max_pages < 1)
+		max_pages = 1;
+	if (max_pages > cache_pages)
+		max_pages = cache_pages;
+
+	c = kzalloc(sizeof(*c), GFP_KERNEL);
+	if (c == NULL)
+		return NULL;
+	mutex_init(&c->lock);
+	INIT_LIST_HEAD(&c->lru);
+	for (i = 0; i < NAND_CACHE_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&c->hash[i]);
+	c->stride = mtd->writesize + mtd->oobsize;
+	c->raw_size = mtd->size;
+	do_div(c->raw_size, mtd->writesize);
+	c->raw_size *= c->stride;
+	c->next_addr = -1ULL;
+	c->max_pages = max_pages;
+	/* Batching only saves anything with multi-page commands */
+	c->wb_max = goldfish_nand_has_ring(mtd) ?
+	            min_t(uint32_t, max(write_batch, 1), max_pages) : 1;
+
+	c->entries = kzalloc(sizeof(*c->entries) * cache_pages, GFP_KERNEL);
+	c->buf = vmalloc(cache_pages * c->stride);
+	c->ra_data = kmalloc(max_pages * mtd->writesize, GFP_KERNEL);
+	c->ra_oob = kmalloc(max_pages * mtd->oobsize, GFP_KERNEL);
+	c->wb_data = kmalloc(max_pages * mtd->writesize, GFP_KERNEL);
+	c->wb_oob = kmalloc(max_pages * mtd->oobsize, GFP_KERNEL);
+	if (!c->entries || !c->buf || !c->ra_data || !c->ra_oob ||
+	    !c->wb_data || !c->wb_oob) {
+		nand_free_cache(c);
+		return NULL;
+	}
+
+	for (i = 0; i < cache_pages; i++) {
+		c->entries[i].buf = c->buf + i * c->stride;
+		list_add_tail(&c->entries[i].lru, &c->lru);
+	}
+	return c;
+}
+
+static ssize_t goldfish_nand_show_cache_stats(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct goldfish_nand *nand = dev_get_drvdata(dev);
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < nand->mtd_count; i++) {
+		struct goldfish_nand_cache *c = nand->caches[i];
+
+		if (c == NULL)
+			continue;
+		len += snprintf(buf + len, PAGE_SIZE - len,
+		                "%s: hits %lu misses %lu readahead %lu "
+		                "batched_writes %lu flushes %lu\n",
+		                nand->mtd[i].name, c->hits, c->misses,
+		                c->readahead, c->writes_batched, c->flushes);
+	}
+	return len;
+}
+
+static DEVICE_ATTR(cache_stats, S_IRUGO, goldfish_nand_show_cache_stats,
+                   NULL);
+
 static int goldfish_nand_erase(struct mtd_info *mtd, struct erase_info *instr)
 {
 	loff_t ofs = instr->addr;
 	uint32_t len = instr->len;
 	uint32_t rem;
+	int ret;
 
 	if (ofs + len > mtd->size)
 		goto invalid_arg;
@@ -109,6 +652,12 @@ static int goldfish_nand_erase(struct mtd_info *mtd, struct erase_info *instr)
 		goto invalid_arg;
 	len = len / mtd->writesize * (mtd->writesize + mtd->oobsize);
 
+	if(goldfish_nand_get_cache(mtd)) {
+		ret = nand_cache_discard(mtd, ofs, len);
+		if(ret)
+			return ret;
+	}
+
 	if(goldfish_nand_cmd(mtd, NAND_CMD_ERASE, ofs, len, NULL) != len) {
 		printk("goldfish_nand_erase: erase failed, start %llx, len %x, dev_size "
 		       "%llx, erase_size %x\n", ofs, len, mtd->size, mtd->erasesize);
@@ -130,10 +679,11 @@ static int goldfish_nand_read_oob(struct mtd_info *mtd, loff_t ofs,
                               struct mtd_oob_ops *ops)
 {
 	uint32_t rem;
+	uint32_t oobretlen;
 
 	if(ofs + ops->len > mtd->size)
 		goto invalid_arg;
-	if(ops->datbuf && ops->len && ops->len != mtd->writesize)
+	if(ops->datbuf && ops->len != mtd->writesize)
 		goto invalid_arg;
 	if(ops->ooblen + ops->ooboffs > mtd->oobsize)
 		goto invalid_arg;
@@ -143,6 +693,24 @@ static int goldfish_nand_read_oob(struct mtd_info *mtd, loff_t ofs,
 		goto invalid_arg;
 	ofs *= (mtd->writesize + mtd->oobsize);
 
+	if(goldfish_nand_get_cache(mtd)) {
+		ops->retlen = ops->oobretlen = 0;
+		return nand_cache_read(mtd, ofs, 1,
+		                       ops->datbuf, ops->ooboffs,
+		                       ops->ooblen, ops->oobbuf, &ops->retlen,
+		                       &ops->oobretlen);
+	}
+
+	if(goldfish_nand_has_ring(mtd)) {
+		/* Data and oob in a single command */
+		ops->retlen = goldfish_nand_ring_cmd(mtd, NAND_CMD_READ, ofs, 1,
+		                        ops->datbuf ? ops->len : 0, ops->datbuf,
+		                        ops->ooboffs, ops->oobbuf ? ops->ooblen : 0,
+		                        ops->oobbuf, &oobretlen);
+		ops->oobretlen = oobretlen;
+		return 0;
+	}
+
 	if(ops->datbuf)
 		ops->retlen = goldfish_nand_cmd(mtd, NAND_CMD_READ, ofs,
 		                            ops->len, ops->datbuf);
@@ -163,11 +731,15 @@ static int goldfish_nand_write_oob(struct mtd_info *mtd, loff_t ofs,
                                struct mtd_oob_ops *ops)
 {
 	uint32_t rem;
+	uint32_t oobretlen;
+	int ret;
 
 	if(ofs + ops->len > mtd->size)
 		goto invalid_arg;
 	if(ops->len && ops->len != mtd->writesize)
 		goto invalid_arg;
+	if(ops->datbuf && ops->len != mtd->writesize)
+		goto invalid_arg;
 	if(ops->ooblen + ops->ooboffs > mtd->oobsize)
 		goto invalid_arg;
 	
@@ -176,6 +748,27 @@ static int goldfish_nand_write_oob(struct mtd_info *mtd, loff_t ofs,
 		goto invalid_arg;
 	ofs *= (mtd->writesize + mtd->oobsize);
 
+	if(goldfish_nand_get_cache(mtd)) {
+		ret = nand_cache_write(mtd, ofs, ops->datbuf, ops->ooboffs,
+		                       ops->ooblen, ops->oobbuf);
+		if(ret < 0)
+			return ret;
+		if(ret == 0) {
+			ops->retlen = ops->len;
+			ops->oobretlen = ops->ooblen;
+			return 0;
+		}
+	}
+
+	if(goldfish_nand_has_ring(mtd)) {
+		ops->retlen = goldfish_nand_ring_cmd(mtd, NAND_CMD_WRITE, ofs, 1,
+		                        ops->datbuf ? ops->len : 0, ops->datbuf,
+		                        ops->ooboffs, ops->oobbuf ? ops->ooblen : 0,
+		                        ops->oobbuf, &oobretlen);
+		ops->oobretlen = oobretlen;
+		return 0;
+	}
+
 	if(ops->datbuf)
 		ops->retlen = goldfish_nand_cmd(mtd, NAND_CMD_WRITE, ofs,
 		                            ops->len, ops->datbuf);
@@ -199,7 +792,7 @@ static int goldfish_nand_read(struct mtd_info *mtd, loff_t from, size_t len,
 
 	if(from + len > mtd->size)
 		goto invalid_arg;
-	if(len != mtd->writesize)
+	if(!goldfish_nand_valid_len(mtd, len))
 		goto invalid_arg;
 
 	rem = do_div(from, mtd->writesize);
@@ -207,7 +800,18 @@ static int goldfish_nand_read(struct mtd_info *mtd, loff_t from, size_t len,
 		goto invalid_arg;
 	from *= (mtd->writesize + mtd->oobsize);
 
-	*retlen = goldfish_nand_cmd(mtd, NAND_CMD_READ, from, len, buf);
+	if(goldfish_nand_get_cache(mtd)) {
+		*retlen = 0;
+		return nand_cache_read(mtd, from, len / mtd->writesize, buf,
+		                       0, 0, NULL, retlen, NULL);
+	}
+
+	if(goldfish_nand_has_ring(mtd))
+		*retlen = goldfish_nand_ring_cmd(mtd, NAND_CMD_READ, from,
+		                        len / mtd->writesize, mtd->writesize, buf,
+		                        0, 0, NULL, NULL);
+	else
+		*retlen = goldfish_nand_cmd(mtd, NAND_CMD_READ, from, len, buf);
 	return 0;
 
 invalid_arg:
@@ -220,10 +824,11 @@ static int goldfish_nand_write(struct mtd_info *mtd, loff_t to, size_t len,
                            size_t *retlen, const u_char *buf)
 {
 	uint32_t rem;
+	int ret;
 
 	if(to + len > mtd->size)
 		goto invalid_arg;
-	if(len != mtd->writesize)
+	if(!goldfish_nand_valid_len(mtd, len))
 		goto invalid_arg;
 
 	rem = do_div(to, mtd->writesize);
@@ -231,7 +836,22 @@ static int goldfish_nand_write(struct mtd_info *mtd, loff_t to, size_t len,
 		goto invalid_arg;
 	to *= (mtd->writesize + mtd->oobsize);
 
-	*retlen = goldfish_nand_cmd(mtd, NAND_CMD_WRITE, to, len, (void *)buf);
+	/* Data only writes are never batched, this just keeps the cache
+	 * coherent for every page written */
+	if(goldfish_nand_get_cache(mtd)) {
+		ret = nand_cache_discard(mtd, to, (uint64_t)(len /
+		                mtd->writesize) * (mtd->writesize + mtd->oobsize));
+		if(ret)
+			return ret;
+	}
+
+	if(goldfish_nand_has_ring(mtd))
+		*retlen = goldfish_nand_ring_cmd(mtd, NAND_CMD_WRITE, to,
+		                        len / mtd->writesize, mtd->writesize,
+		                        (void *)buf, 0, 0, NULL, NULL);
+	else
+		*retlen = goldfish_nand_cmd(mtd, NAND_CMD_WRITE, to, len,
+		                            (void *)buf);
 	return 0;
 
 invalid_arg:
@@ -264,6 +884,7 @@ invalid_arg:
 static int goldfish_nand_block_markbad(struct mtd_info *mtd, loff_t ofs)
 {
 	uint32_t rem;
+	int ret;
 
 	if(ofs >= mtd->size)
 		goto invalid_arg;
@@ -274,6 +895,9 @@ static int goldfish_nand_block_markbad(struct mtd_info *mtd, loff_t ofs)
 	ofs *= mtd->erasesize / mtd->writesize;
 	ofs *= (mtd->writesize + mtd->oobsize);
 
+	ret = nand_cache_sync(mtd);
+	if(ret)
+		return ret;
 	if(goldfish_nand_cmd(mtd, NAND_CMD_BLOCK_BAD_SET, ofs, 0, NULL) != 1)
 		return -EIO;
 	return 0;
@@ -299,6 +923,44 @@ static int nand_setup_cmd_params(struct goldfish_nand *nand)
 	return 0;
 }
 
+static int nand_setup_ring(struct goldfish_nand *nand)
+{
+	uint64_t paddr;
+	unsigned char __iomem  *base = nand->base;
+	int i;
+
+	if (nand->ring || nand->irq < 0)
+		return 0;
+
+	nand->ring = kzalloc(sizeof(*nand->ring) * NAND_RING_ENTRIES,
+	                     GFP_KERNEL);
+	nand->slots = kzalloc(sizeof(*nand->slots) * NAND_RING_ENTRIES,
+	                      GFP_KERNEL);
+	if (!nand->ring || !nand->slots)
+		goto err;
+	for (i = 0; i < NAND_RING_ENTRIES; i++)
+		init_completion(&nand->slots[i].done);
+	spin_lock_init(&nand->ring_lock);
+	sema_init(&nand->ring_free, NAND_RING_ENTRIES);
+
+	if (request_irq(nand->irq, goldfish_nand_interrupt, IRQF_SHARED,
+	                "goldfish_nand", nand))
+		goto err;
+
+	paddr = __pa(nand->ring);
+	writel((uint32_t)(paddr >> 32), base + NAND_RING_ADDR_HIGH);
+	writel((uint32_t)paddr, base + NAND_RING_ADDR_LOW);
+	writel(NAND_RING_ENTRIES, base + NAND_RING_SIZE);
+	return 0;
+
+err:
+	kfree(nand->ring);
+	kfree(nand->slots);
+	nand->ring = NULL;
+	nand->slots = NULL;
+	return -1;
+}
+
 static int goldfish_nand_init_device(struct goldfish_nand *nand, int id)
 {
 	uint32_t name_len;
@@ -349,6 +1011,8 @@ static int goldfish_nand_init_device(struct goldfish_nand *nand, int id)
 		mtd->flags &= ~MTD_WRITEABLE;
 	if(flags & NAND_DEV_FLAG_CMD_PARAMS_CAP)
 	    nand_setup_cmd_params(nand);
+	if(flags & NAND_DEV_FLAG_RING_CAP)
+	    nand_setup_ring(nand);
 
 	mtd->owner = THIS_MODULE;
 	mtd->erase = goldfish_nand_erase;
@@ -358,8 +1022,20 @@ static int goldfish_nand_init_device(struct goldfish_nand *nand, int id)
 	mtd->write_oob = goldfish_nand_write_oob;
 	mtd->block_isbad = goldfish_nand_block_isbad;
 	mtd->block_markbad = goldfish_nand_block_markbad;
+	mtd->sync = goldfish_nand_sync;
+
+	if (nand->caches) {
+		nand->caches[id] = nand_alloc_cache(mtd);
+		if (nand->caches[id] == NULL)
+			printk("goldfish nand dev%d: no memory for page cache\n",
+			       id);
+	}
 
 	if (add_mtd_device(mtd)) {
+		if (nand->caches) {
+			nand_free_cache(nand->caches[id]);
+			nand->caches[id] = NULL;
+		}
 		kfree(mtd->name);
 		mtd->name = NULL;
 		return -EIO;
@@ -413,6 +1089,14 @@ static int goldfish_nand_probe(struct platform_device *pdev)
 	nand->mtd_count = num_dev;
 	platform_set_drvdata(pdev, nand);
 
+	/* The interrupt is only needed by the command ring */
+	r = platform_get_resource(pdev, IORESOURCE_IRQ, 0);
+	nand->irq = r ? r->start : -1;
+
+	if (cache_pages > 0)
+		nand->caches = kcalloc(num_dev, sizeof(*nand->caches),
+		                       GFP_KERNEL);
+
 	num_dev_working = 0;
 	for(i = 0; i < num_dev; i++) {
 		err = goldfish_nand_init_device(nand, i);
@@ -423,9 +1107,13 @@ static int goldfish_nand_probe(struct platform_device *pdev)
 		err = -ENODEV;
 		goto err_no_working_dev;
 	}
+	if (nand->caches &&
+	    device_create_file(&pdev->dev, &dev_attr_cache_stats))
+		printk("goldfish_nand: failed to create cache_stats\n");
 	return 0;
 
 err_no_working_dev:
+	kfree(nand->caches);
 	kfree(nand);
 err_nand_alloc_failed:
 err_no_dev:
@@ -439,14 +1127,26 @@ static int goldfish_nand_remove(struct platform_device *pdev)
 {
 	struct goldfish_nand *nand = platform_get_drvdata(pdev);
 	int i;
+	if (nand->caches)
+		device_remove_file(&pdev->dev, &dev_attr_cache_stats);
 	for(i = 0; i < nand->mtd_count; i++) {
 		if(nand->mtd[i].name) {
 			del_mtd_device(&nand->mtd[i]);
+			goldfish_nand_sync(&nand->mtd[i]);
 			kfree(nand->mtd[i].name);
 		}
+		if (nand->caches)
+			nand_free_cache(nand->caches[i]);
 	}
+	kfree(nand->caches);
 	if (nand->cmd_params)
 	    kfree(nand->cmd_params);
+	if (nand->ring) {
+		writel(0, nand->base + NAND_RING_SIZE);
+		free_irq(nand->irq, nand);
+		kfree(nand->ring);
+		kfree(nand->slots);
+	}
 	iounmap(nand->base);
 	kfree(nand);
 	return 0;
@@ -31,6 +31,7 @@ enum nand_cmd {
 enum nand_dev_flags {
     NAND_DEV_FLAG_READ_ONLY = 0x00000001,
     NAND_DEV_FLAG_CMD_PARAMS_CAP = 0x00000002,
+    NAND_DEV_FLAG_RING_CAP = 0x00000004,
 };
 
 #define NAND_VERSION_CURRENT (1)
@@ -59,6 +60,13 @@ enum nand_reg {
 	NAND_ADDR_HIGH      = 0x054,
 	NAND_CMD_PARAMS_ADDR_LOW = 0x058,
 	NAND_CMD_PARAMS_ADDR_HIGH = 0x05c,
+
+	// Command ring
+	NAND_RING_ADDR_LOW  = 0x060,
+	NAND_RING_ADDR_HIGH = 0x064,
+	NAND_RING_SIZE      = 0x068, // write: number of entries, enables ring
+	NAND_RING_DOORBELL  = 0x06c, // write: process submitted entries
+	NAND_IRQ_STATUS     = 0x070, // read: completions pending, clears irq
 };
 
 struct cmd_params{
@@ -69,4 +77,30 @@ struct cmd_params{
 	uint32_t data;
 	uint32_t result;
 };
+
+enum nand_ring_entry_state {
+	NAND_RING_ENTRY_FREE,
+	NAND_RING_ENTRY_SUBMITTED,  // set by the guest
+	NAND_RING_ENTRY_DONE,       // set by the emulator, irq raised
+};
+
+// Command ring entry. 'pages' consecutive pages starting at addr are
+// accessed; for each of them data_size bytes go to/from data and
+// oob_size bytes at oob_offset in the extra area go to/from oob.
+// For NAND_CMD_ERASE, data_size is the length to erase.
+struct nand_ring_entry {
+	uint32_t state;
+	uint32_t cmd;               // NAND_CMD_READ, _WRITE or _ERASE
+	uint32_t dev;
+	uint32_t addr_low;
+	uint32_t addr_high;
+	uint32_t pages;
+	uint32_t data_size;
+	uint32_t data;
+	uint32_t oob_offset;
+	uint32_t oob_size;
+	uint32_t oob;
+	uint32_t result;            // data bytes transferred
+	uint32_t oob_result;        // oob bytes transferred
+};
 #endif
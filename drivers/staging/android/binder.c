@@ -19,9 +19,12 @@
 #include <linux/fdtable.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/hrtimer.h>
+#include <linux/kref.h>
 #include <linux/list.h>
 #include <linux/miscdevice.h>
 #include <linux/mm.h>
+#include <linux/mman.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/nsproxy.h>
@@ -31,21 +34,50 @@
 #include <linux/sched.h>
 #include <linux/uaccess.h>
 #include <linux/vmalloc.h>
+#include <trace/binder.h>
 #include "binder.h"
 
-static DEFINE_MUTEX(binder_lock);
+/*
+ * Locking:
+ *
+ * binder_main_lock protects the object graph: nodes, refs, threads,
+ * transactions, todo lists and the allocated buffers of every proc.
+ * It is dropped while a thread sleeps in binder_thread_read() and while
+ * binder_transaction() copies the payload from the sender, see
+ * binder_proc.tmp_ref.
+ *
+ * binder_procs_lock protects the binder_procs list, so binder_open()
+ * does not need binder_main_lock.
+ *
+ * binder_deferred_lock protects binder_deferred_list and
+ * binder_proc.deferred_work.
+ *
+ * Lock order: binder_main_lock -> binder_procs_lock -> binder_deferred_lock
+ */
+static DEFINE_MUTEX(binder_main_lock);
+static DEFINE_MUTEX(binder_procs_lock);
 static HLIST_HEAD(binder_procs);
 static struct binder_node *binder_context_mgr_node;
 static uid_t binder_context_mgr_uid = -1;
 static int binder_last_id;
 static struct proc_dir_entry *binder_proc_dir_entry_root;
 static struct proc_dir_entry *binder_proc_dir_entry_proc;
+static struct proc_dir_entry *binder_proc_dir_entry_latency;
 static struct hlist_head binder_dead_nodes;
 static HLIST_HEAD(binder_deferred_list);
 static DEFINE_MUTEX(binder_deferred_lock);
+static DECLARE_WAIT_QUEUE_HEAD(binder_tmp_ref_wait);
 
 static int binder_read_proc_proc(
 	char *page, char **start, off_t off, int count, int *eof, void *data);
+static int binder_read_proc_latency(
+	char *page, char **start, off_t off, int count, int *eof, void *data);
+
+DEFINE_TRACE(binder_transaction_queued);
+DEFINE_TRACE(binder_transaction_dequeued);
+DEFINE_TRACE(binder_transaction_replied);
+DEFINE_TRACE(binder_buffer_alloc);
+DEFINE_TRACE(binder_buffer_free);
 
 /* This is only defined in include/asm-arm/sizes.h */
 #ifndef SZ_1K
@@ -60,6 +92,37 @@ static int binder_read_proc_proc(
 
 #define BINDER_SMALL_BUF_SIZE (PAGE_SIZE * 64)
 
+/*
+ * Small buffers are rounded up to one of these size classes, and freed
+ * ones are kept per class for reuse instead of being merged back into
+ * the free tree: 128, 256, 512, 1K and 2K bytes.
+ */
+#define BINDER_QUICK_MIN_SHIFT	7
+#define BINDER_QUICK_CLASSES	5
+#define BINDER_QUICK_MAX	(1U << (BINDER_QUICK_MIN_SHIFT + BINDER_QUICK_CLASSES - 1))
+
+/* BINDER_TYPE_PAGES objects are mapped through binder_mmap() at this offset */
+#define BINDER_PAGES_MMAP_OFFSET	PAGE_SIZE
+#define BINDER_MAX_PAGE_OBJECT		(SZ_4M * 2)
+/* Limits on what BINDER_TYPE_PAGES objects can pin: per transaction, and
+ * per receiving proc for all its not yet freed buffers */
+#define BINDER_MAX_PAGE_OBJECTS		16
+#define BINDER_MAX_TRANSACTION_PAGES	(BINDER_MAX_PAGE_OBJECT >> PAGE_SHIFT)
+#define BINDER_MAX_PROC_PAGES		((SZ_4M * 8) >> PAGE_SHIFT)
+
+/* Sender pages referenced by a BINDER_TYPE_PAGES object. Owned by the
+ * buffer, and by the receiver's mapping while it exists. */
+struct binder_page_object {
+	struct binder_page_object *next;	/* in binder_buffer.page_objects */
+	struct kref kref;
+	size_t offset;				/* of the object in the buffer */
+	struct mm_struct *mm;			/* receiver mapping, if any;
+						 * holds an mm_count reference */
+	unsigned long user_addr;
+	int nr_pages;
+	struct page *pages[0];
+};
+
 enum {
 	BINDER_DEBUG_USER_ERROR             = 1U << 0,
 	BINDER_DEBUG_FAILED_TRANSACTION     = 1U << 1,
@@ -83,6 +146,10 @@ static uint32_t binder_debug_mask = BINDER_DEBUG_USER_ERROR |
 module_param_named(debug_mask, binder_debug_mask, uint, S_IWUSR | S_IRUGO);
 static int binder_debug_no_lock;
 module_param_named(proc_no_lock, binder_debug_no_lock, bool, S_IWUSR | S_IRUGO);
+static int binder_quick_depth = 16;
+module_param_named(quick_depth, binder_quick_depth, int, S_IWUSR | S_IRUGO);
+static int binder_lazy_pages = 64;
+module_param_named(lazy_pages, binder_lazy_pages, int, S_IWUSR | S_IRUGO);
 static DECLARE_WAIT_QUEUE_HEAD(binder_user_error_wait);
 static int binder_stop_on_user_error;
 static int binder_set_stop_on_user_error(
@@ -137,6 +204,27 @@ struct binder_transaction_log_entry {
 	int data_size;
 	int offsets_size;
 };
+/*
+ * Latency histogram with power of two buckets: bucket 0 counts samples
+ * below 1us, bucket i samples in [2^(i-1), 2^i) us and the last bucket
+ * everything above. Buckets are atomic so they can be read without
+ * binder_main_lock.
+ */
+#define BINDER_LATENCY_BUCKETS 24
+
+struct binder_latency_hist {
+	atomic_t bucket[BINDER_LATENCY_BUCKETS];
+};
+
+static void binder_latency_add(struct binder_latency_hist *hist, s64 us)
+{
+	int i = us > 0 ? fls64(us) : 0;
+
+	if (i >= BINDER_LATENCY_BUCKETS)
+		i = BINDER_LATENCY_BUCKETS - 1;
+	atomic_inc(&hist->bucket[i]);
+}
+
 struct binder_transaction_log {
 	int next;
 	int full;
@@ -353,8 +441,11 @@ struct binder_buffer {
 	//entry就是这个内核缓冲区列表的一个节点。
 	struct list_head entry; /* free and allocated entries by addesss */
 	//进程使用红黑树来分别保存那些正在使用的内核缓冲区和空闲的内核缓冲区。通过另一个成员变量free表示是否是空闲的。
-	struct rb_node rb_node; /* free entry by size or allocated entry */
-				/* by address */
+	union {
+		struct rb_node rb_node; /* free entry by size or allocated entry */
+					/* by address */
+		struct list_head quick_entry; /* in proc->quick_buffers */
+	};
 	//如果一个内核缓冲区是空闲的，free == 1
 	unsigned free : 1;
 
@@ -365,6 +456,7 @@ struct binder_buffer {
 	//的成员变量allow_user_free的值为1，那么该Service组件就会请求Binder驱动程序释放该内核缓冲区。
 	struct binder_transaction *transaction;
 	struct binder_node *target_node;
+	struct binder_page_object *page_objects;
 
 	//是否允许释放该内存缓冲区
 	unsigned allow_user_free : 1;
@@ -419,6 +511,18 @@ enum {
  * hash列表中，而成员变量proc_node就正好时该hash列表中的一个节点。
  * 
  */
+struct binder_alloc_stats {
+	unsigned long allocs;
+	unsigned long frees;
+	unsigned long quick_hits;
+	unsigned long quick_flushes;
+	unsigned long failed;
+	unsigned long pages_allocated;
+	unsigned long pages_reused;
+	unsigned long pages_freed;
+	size_t allocated_bytes;
+};
+
 struct binder_proc {
 	//保存当前binder_proc的一个节点
 	struct hlist_node proc_node;
@@ -438,10 +542,16 @@ struct binder_proc {
 	struct vm_area_struct *vma;
 	//内核空间地址和用户空间地址的差值。这样，给定一个用户空间地址或者一个内核空间地址，Binder驱动程序就可以计算出另外一个地址大小
 	ptrdiff_t user_buffer_offset;
+	/* BINDER_TYPE_PAGES object binder_mmap() is called for */
+	struct binder_page_object *mapping_object;
+	struct task_struct *mapping_task;
 	//内核空间地址和用户空间地址都是虚拟地址，他们对应的物理页面保存在成员变量pages中。成员变量pages是类型为 struc page*的一个数组，
 	//数组中的每一个元素都执行一个物理页面。Binder驱动程序一开始只为该内核分配一个物理页面，后面不够使用时，再继续分配
 	//struct page **pages 代表一个page的二维数组
 	struct page **pages;
+	/* pages used by a buffer; the others in pages[] are mapped lazily */
+	unsigned long *pages_in_use;
+	int lazy_pages;
 
 	//buffer指向一块大的内核缓冲区，Binder驱动程序为了方便对他进行管理，会将他划分为若干个小块。
 	//这些小块的内核缓冲区就是使用前面介绍的binder_buffer来描述的，他们保存在一个列表中，按照地址值从小到大的顺序来排列。成员变量buffers
@@ -458,6 +568,16 @@ struct binder_proc {
 	//保存了当前可以用来保存异步事务数据的内核缓冲区的大小
 	size_t free_async_space;
 
+	struct list_head quick_buffers[BINDER_QUICK_CLASSES];
+	int quick_count[BINDER_QUICK_CLASSES];
+	struct binder_alloc_stats alloc_stats;
+	/* pages pinned by BINDER_TYPE_PAGES objects in allocated buffers */
+	int page_object_pages;
+	/* queued -> BR_TRANSACTION/BR_REPLY read by a thread of this proc */
+	struct binder_latency_hist deliver_latency;
+	/* BR_TRANSACTION read -> BC_REPLY written by a thread of this proc */
+	struct binder_latency_hist reply_latency;
+
 	//每一个使用了Binder进程间通信机制的进程都有一个Binder线程池，用来处理进程间通信请求，这个Binder线程池是由Binder驱动程序来维护的。
 	//threads是一个红黑树的根节点，他以线程ID作为关键字来组织一个进程的Binder线程池。进程可以调用函数ioctl将一个线程注册到Binder驱动程序中，
 	//同时，当进程没有足够的空闲线程处理进程间通信请求时，Binder驱动程序也可以主动要求进程注册更多线程到Binder线程池中。Binder驱动程序最多
@@ -480,6 +600,9 @@ struct binder_proc {
 	//Binder线程池中空闲的Binder线程会睡眠在由成员变量wait所描述的一个等待队列中，当他们的宿主进程的待处理工作项队列增加了新的工作项之后
 	//Binder驱动程序就会唤醒这些线程，以便他们可以去处理新的工作项。
 	wait_queue_head_t wait;
+	/* threads blocked in binder_thread_read() for proc work, most
+	 * recently idle first; poll() users only wait on proc->wait */
+	struct list_head waiting_threads;
 	//初始化进程的优先级。但一个线程处理一个工作项时，他的线程优先级可能会被设置为其宿主进程的优先级，即设置为成员变量default_priority的值，
 	//这是由于线程是代表其宿主进程来处理一个工作项。线程在处理一个工作项时的优先级还会收到其他因素的影响。
 	long default_priority;
@@ -510,6 +633,10 @@ struct binder_proc {
 	//当进程接收到这个死亡通知之后，他便会通知Binder驱动程序，这时候Binder驱动程序就会将对应的工作项
 	//从成员变量delivered_death所描述的队列中删除。
 	struct list_head delivered_death;
+
+	/* Transactions copying into this proc's buffer without holding
+	 * binder_main_lock. Release waits for it to drop to 0. */
+	int tmp_ref;
 };
 
 /**
@@ -577,6 +704,9 @@ struct binder_thread {
 	wait_queue_head_t wait;
 	//用来统计Binder线程数据，例如，Binder线程接收到的进程间通信请求的次数。
 	struct binder_stats stats;
+	struct task_struct *task;
+	/* in proc->waiting_threads while waiting for proc work */
+	struct list_head waiting_thread_node;
 };
 
 /**
@@ -609,6 +739,14 @@ struct binder_transaction {
 	//他的线程优先级不能低于目标Service组件所要求的线程优先级，而且也不能低于源线程的优先级。这时候Binder驱动程序
 	//就会将这二者中较大值设置为目标线程的优先级
 	long	saved_priority;
+	/* scheduling class of the sender, and of the target thread before it
+	 * inherited it (saved_policy is -1 if nothing was inherited) */
+	int	policy;
+	int	rt_priority;
+	int	saved_policy;
+	int	saved_rt_priority;
+	ktime_t	queue_time;
+	ktime_t	deliver_time;
 
 	//指向Binder驱动程序为该事务分配的一块内核缓冲区，它里面保存了进程间通信数据。
 	struct binder_buffer *buffer;
@@ -795,6 +933,62 @@ out_unlock:
 	return -EBADF;
 }
 
+static int binder_is_rt_policy(int policy)
+{
+	return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+static void binder_set_policy(struct task_struct *task, int policy,
+			      int rt_priority)
+{
+	struct sched_param param = { .sched_priority = rt_priority };
+
+	if (task->policy == policy && task->rt_priority == rt_priority)
+		return;
+	if (sched_setscheduler_nocheck(task, policy, &param))
+		binder_user_error("binder: %d: failed to set policy %d prio %d\n",
+				  task->pid, policy, rt_priority);
+}
+
+/*
+ * Undo the real-time policy 'task' inherited when it received 't'. Must
+ * be done on every path that ends the transaction, not just BC_REPLY,
+ * or the thread keeps running later work at the caller's priority.
+ */
+static void binder_restore_policy(struct task_struct *task,
+				  struct binder_transaction *t)
+{
+	if (t->saved_policy < 0)
+		return;
+	binder_set_policy(task, t->saved_policy, t->saved_rt_priority);
+	t->saved_policy = -1;
+}
+
+/*
+ * Wake one thread for new proc work. A thread that last ran on this CPU
+ * is preferred, since a synchronous caller is about to block here.
+ * Otherwise the thread that went idle last is used, as it has the
+ * warmest cache. Threads using poll() are not on waiting_threads.
+ */
+static void binder_wakeup_proc(struct binder_proc *proc)
+{
+	struct binder_thread *thread;
+	int cpu = raw_smp_processor_id();
+
+	if (list_empty(&proc->waiting_threads)) {
+		wake_up_interruptible(&proc->wait);
+		return;
+	}
+	list_for_each_entry(thread, &proc->waiting_threads, waiting_thread_node)
+		if (task_cpu(thread->task) == cpu)
+			goto found;
+	thread = list_first_entry(&proc->waiting_threads,
+				  struct binder_thread, waiting_thread_node);
+found:
+	list_del_init(&thread->waiting_thread_node);
+	wake_up_interruptible(&thread->wait);
+}
+
 static void binder_set_nice(long nice)
 {
 	long min_nice;
@@ -942,9 +1136,18 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
 		int ret;
 		struct page **page_array_ptr;
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-
-		BUG_ON(*page);
+		size_t index = (page_addr - proc->buffer) / PAGE_SIZE;
+		page = &proc->pages[index];
+
+		BUG_ON(test_bit(index, proc->pages_in_use));
+		if (*page) {
+			/* still mapped, see binder_put_page_range() */
+			set_bit(index, proc->pages_in_use);
+			proc->lazy_pages--;
+			proc->alloc_stats.pages_reused++;
+			continue;
+		}
+		proc->alloc_stats.pages_allocated++;
 		*page = alloc_page(GFP_KERNEL | __GFP_ZERO);
 		if (*page == NULL) {
 			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
@@ -971,6 +1174,7 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 			goto err_vm_insert_page_failed;
 		}
 		/* vm_insert_page does not seem to increment the refcount */
+		set_bit(index, proc->pages_in_use);
 	}
 	if (mm) {
 		up_write(&mm->mmap_sem);
@@ -982,6 +1186,8 @@ free_range:
 	for (page_addr = end - PAGE_SIZE; page_addr >= start;
 	     page_addr -= PAGE_SIZE) {
 		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		clear_bit(page - proc->pages, proc->pages_in_use);
+		proc->alloc_stats.pages_freed++;
 		if (vma)
 			zap_page_range(vma, (uintptr_t)page_addr +
 				proc->user_buffer_offset, PAGE_SIZE, NULL);
@@ -1001,6 +1207,101 @@ err_no_vma:
 	return -ENOMEM;
 }
 
+/* Map the pages of a new buffer, without touching the mm if they are
+ * all still mapped from earlier buffers. */
+static int binder_get_page_range(struct binder_proc *proc,
+	void *start, void *end)
+{
+	void *page_addr;
+	size_t index;
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE)
+		if (!proc->pages[(page_addr - proc->buffer) / PAGE_SIZE])
+			return binder_update_page_range(proc, 1, start, end, NULL);
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		index = (page_addr - proc->buffer) / PAGE_SIZE;
+		BUG_ON(test_bit(index, proc->pages_in_use));
+		set_bit(index, proc->pages_in_use);
+		proc->lazy_pages--;
+		proc->alloc_stats.pages_reused++;
+	}
+	return 0;
+}
+
+/* Unmap unused pages until at most half of binder_lazy_pages are left */
+static void binder_shrink_pages(struct binder_proc *proc)
+{
+	size_t i, j, npages = proc->buffer_size / PAGE_SIZE;
+
+	for (i = 0; i < npages && proc->lazy_pages > binder_lazy_pages / 2;
+	     i = j + 1) {
+		for (j = i; j < npages && proc->pages[j] &&
+			    !test_bit(j, proc->pages_in_use); j++)
+			;
+		if (j == i)
+			continue;
+		binder_update_page_range(proc, 0, proc->buffer + i * PAGE_SIZE,
+					 proc->buffer + j * PAGE_SIZE, NULL);
+		proc->lazy_pages -= j - i;
+	}
+}
+
+/* Pages of a freed buffer stay mapped so the next allocation in the
+ * same range does not need to allocate and map them again. */
+static void binder_put_page_range(struct binder_proc *proc,
+	void *start, void *end)
+{
+	void *page_addr;
+	size_t index;
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		index = (page_addr - proc->buffer) / PAGE_SIZE;
+		BUG_ON(!proc->pages[index]);
+		clear_bit(index, proc->pages_in_use);
+		proc->lazy_pages++;
+	}
+	if (proc->lazy_pages > binder_lazy_pages)
+		binder_shrink_pages(proc);
+}
+
+static int binder_quick_class(size_t size)
+{
+	if (size <= (1U << BINDER_QUICK_MIN_SHIFT))
+		return 0;
+	return fls(size - 1) - BINDER_QUICK_MIN_SHIFT;
+}
+
+static int binder_quick_cached(struct binder_proc *proc)
+{
+	int i, count = 0;
+
+	for (i = 0; i < BINDER_QUICK_CLASSES; i++)
+		count += proc->quick_count[i];
+	return count;
+}
+
+static void binder_release_buf_space(struct binder_proc *proc,
+	struct binder_buffer *buffer);
+
+/* Give all cached small buffers back to the free tree */
+static void binder_quick_flush(struct binder_proc *proc)
+{
+	struct binder_buffer *buffer;
+	int i;
+
+	for (i = 0; i < BINDER_QUICK_CLASSES; i++) {
+		while (!list_empty(&proc->quick_buffers[i])) {
+			buffer = list_first_entry(&proc->quick_buffers[i],
+					struct binder_buffer, quick_entry);
+			list_del(&buffer->quick_entry);
+			binder_release_buf_space(proc, buffer);
+		}
+		proc->quick_count[i] = 0;
+	}
+	proc->alloc_stats.quick_flushes++;
+}
+
 static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	size_t data_size, size_t offsets_size, int is_async)
 {
@@ -1010,7 +1311,8 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	struct rb_node *best_fit = NULL;
 	void *has_page_addr;
 	void *end_page_addr;
-	size_t size;
+	size_t size, alloc_size;
+	int qclass = -1;
 
 	if (proc->vma == NULL) {
 		printk(KERN_ERR "binder: %d: binder_alloc_buf, no vma\n",
@@ -1032,18 +1334,36 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		if (binder_debug_mask & BINDER_DEBUG_BUFFER_ALLOC)
 			printk(KERN_ERR "binder: %d: binder_alloc_buf size %zd f"
 			       "ailed, no async space left\n", proc->pid, size);
+		proc->alloc_stats.failed++;
 		return NULL;
 	}
 
+	alloc_size = size;
+	if (size <= BINDER_QUICK_MAX) {
+		qclass = binder_quick_class(size);
+		alloc_size = 1U << (BINDER_QUICK_MIN_SHIFT + qclass);
+		if (!list_empty(&proc->quick_buffers[qclass])) {
+			buffer = list_first_entry(&proc->quick_buffers[qclass],
+					struct binder_buffer, quick_entry);
+			list_del(&buffer->quick_entry);
+			proc->quick_count[qclass]--;
+			proc->alloc_stats.quick_hits++;
+			binder_insert_allocated_buffer(proc, buffer);
+			goto got_buffer;
+		}
+	}
+
+retry:
+	n = proc->free_buffers.rb_node;
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(!buffer->free);
 		buffer_size = binder_buffer_size(proc, buffer);
 
-		if (size < buffer_size) {
+		if (alloc_size < buffer_size) {
 			best_fit = n;
 			n = n->rb_left;
-		} else if (size > buffer_size)
+		} else if (alloc_size > buffer_size)
 			n = n->rb_right;
 		else {
 			best_fit = n;
@@ -1051,8 +1371,13 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		}
 	}
 	if (best_fit == NULL) {
+		if (binder_quick_cached(proc)) {
+			binder_quick_flush(proc);
+			goto retry;
+		}
 		printk(KERN_ERR "binder: %d: binder_alloc_buf size %zd failed, "
 		       "no address space\n", proc->pid, size);
+		proc->alloc_stats.failed++;
 		return NULL;
 	}
 	if (n == NULL) {
@@ -1066,24 +1391,26 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	has_page_addr =
 		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK);
 	if (n == NULL) {
-		if (size + sizeof(struct binder_buffer) + 4 >= buffer_size)
-			buffer_size = size; /* no room for other buffers */
+		if (alloc_size + sizeof(struct binder_buffer) + 4 >= buffer_size)
+			buffer_size = alloc_size; /* no room for other buffers */
 		else
-			buffer_size = size + sizeof(struct binder_buffer);
+			buffer_size = alloc_size + sizeof(struct binder_buffer);
 	}
 	end_page_addr =
 		(void *)PAGE_ALIGN((uintptr_t)buffer->data + buffer_size);
 	if (end_page_addr > has_page_addr)
 		end_page_addr = has_page_addr;
-	if (binder_update_page_range(proc, 1,
-	    (void *)PAGE_ALIGN((uintptr_t)buffer->data), end_page_addr, NULL))
+	if (binder_get_page_range(proc,
+	    (void *)PAGE_ALIGN((uintptr_t)buffer->data), end_page_addr)) {
+		proc->alloc_stats.failed++;
 		return NULL;
+	}
 
 	rb_erase(best_fit, &proc->free_buffers);
 	buffer->free = 0;
 	binder_insert_allocated_buffer(proc, buffer);
-	if (buffer_size != size) {
-		struct binder_buffer *new_buffer = (void *)buffer->data + size;
+	if (buffer_size != alloc_size) {
+		struct binder_buffer *new_buffer = (void *)buffer->data + alloc_size;
 		list_add(&new_buffer->entry, &buffer->entry);
 		new_buffer->free = 1;
 		binder_insert_free_buffer(proc, new_buffer);
@@ -1091,6 +1418,10 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	if (binder_debug_mask & BINDER_DEBUG_BUFFER_ALLOC)
 		printk(KERN_INFO "binder: %d: binder_alloc_buf size %zd got "
 		       "%p\n", proc->pid, size, buffer);
+got_buffer:
+	buffer->page_objects = NULL;
+	proc->alloc_stats.allocs++;
+	proc->alloc_stats.allocated_bytes += size;
 	buffer->data_size = data_size;
 	buffer->offsets_size = offsets_size;
 	buffer->async_transaction = is_async;
@@ -1101,6 +1432,7 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 			       "async free %zd\n", proc->pid, size,
 			       proc->free_async_space);
 	}
+	trace_binder_buffer_alloc(proc->pid, buffer->data, size, is_async);
 
 	return buffer;
 }
@@ -1155,10 +1487,194 @@ static void binder_delete_free_buffer(
 			       "not share page%s%s with with %p or %p\n",
 			       proc->pid, buffer, free_page_start ? "" : " end",
 			       free_page_end ? "" : " start", prev, next);
-		binder_update_page_range(proc, 0, free_page_start ?
+		binder_put_page_range(proc, free_page_start ?
 			buffer_start_page(buffer) : buffer_end_page(buffer),
 			(free_page_end ? buffer_end_page(buffer) :
-			buffer_start_page(buffer)) + PAGE_SIZE, NULL);
+			buffer_start_page(buffer)) + PAGE_SIZE);
+	}
+}
+
+static struct vm_operations_struct binder_pages_vm_ops;
+
+static void binder_page_object_release(struct kref *kref)
+{
+	struct binder_page_object *obj =
+		container_of(kref, struct binder_page_object, kref);
+	int i;
+
+	for (i = 0; i < obj->nr_pages; i++)
+		put_page(obj->pages[i]);
+	if (obj->mm)
+		mmdrop(obj->mm);
+	kfree(obj);
+}
+
+/* Pin the sender's pages for a BINDER_TYPE_PAGES object */
+static struct binder_page_object *binder_get_page_object(
+	struct flat_binder_object *fp)
+{
+	struct binder_page_object *obj;
+	unsigned long start = (unsigned long)fp->binder;
+	size_t size = (size_t)fp->cookie;
+	int nr_pages, ret;
+
+	if ((start & ~PAGE_MASK) || size == 0 || size > BINDER_MAX_PAGE_OBJECT)
+		return NULL;
+	nr_pages = PAGE_ALIGN(size) >> PAGE_SHIFT;
+
+	obj = kmalloc(sizeof(*obj) + nr_pages * sizeof(obj->pages[0]),
+		      GFP_KERNEL);
+	if (obj == NULL)
+		return NULL;
+
+	down_read(&current->mm->mmap_sem);
+	ret = get_user_pages(current, current->mm, start, nr_pages, 0, 0,
+			     obj->pages, NULL);
+	up_read(&current->mm->mmap_sem);
+	if (ret < nr_pages) {
+		while (ret > 0)
+			put_page(obj->pages[--ret]);
+		kfree(obj);
+		return NULL;
+	}
+	kref_init(&obj->kref);
+	obj->nr_pages = nr_pages;
+	obj->mm = NULL;
+	obj->user_addr = 0;
+	return obj;
+}
+
+/*
+ * Pin the pages of every BINDER_TYPE_PAGES object in a transaction buffer.
+ * Called without binder_main_lock, like the payload copy, since faulting
+ * in the sender's pages can take a while. Objects at invalid offsets are
+ * skipped; binder_transaction() rejects them itself. The pinned objects
+ * are returned in *pinned, also on failure.
+ */
+static int binder_pin_page_objects(struct binder_buffer *buffer,
+	size_t *offp, size_t offsets_size, struct binder_page_object **pinned)
+{
+	size_t *off_end = (void *)offp + offsets_size;
+	struct flat_binder_object *fp;
+	struct binder_page_object *obj;
+	int count = 0, pages = 0;
+
+	*pinned = NULL;
+	if (!IS_ALIGNED(offsets_size, sizeof(size_t)))
+		return 0;
+	for (; offp < off_end; offp++) {
+		if (*offp > buffer->data_size - sizeof(*fp) ||
+		    buffer->data_size < sizeof(*fp) ||
+		    !IS_ALIGNED(*offp, sizeof(void *)))
+			continue;
+		fp = (struct flat_binder_object *)(buffer->data + *offp);
+		if (fp->type != BINDER_TYPE_PAGES)
+			continue;
+		if (++count > BINDER_MAX_PAGE_OBJECTS)
+			return -E2BIG;
+		obj = binder_get_page_object(fp);
+		if (obj == NULL)
+			return -EFAULT;
+		obj->offset = *offp;
+		obj->next = *pinned;
+		*pinned = obj;
+		pages += obj->nr_pages;
+		if (pages > BINDER_MAX_TRANSACTION_PAGES)
+			return -E2BIG;
+	}
+	return 0;
+}
+
+/* Take the object pinned for the BINDER_TYPE_PAGES object at offset */
+static struct binder_page_object *binder_take_page_object(
+	struct binder_page_object **pinned, size_t offset)
+{
+	struct binder_page_object *obj;
+
+	for (; (obj = *pinned); pinned = &obj->next) {
+		if (obj->offset == offset) {
+			*pinned = obj->next;
+			obj->next = NULL;
+			return obj;
+		}
+	}
+	return NULL;
+}
+
+static void binder_unpin_page_objects(struct binder_page_object *pinned)
+{
+	struct binder_page_object *obj;
+
+	while ((obj = pinned)) {
+		pinned = obj->next;
+		kref_put(&obj->kref, binder_page_object_release);
+	}
+}
+
+/* Map the page objects of a buffer that is being delivered to current */
+static void binder_map_page_objects(struct binder_proc *proc,
+	struct binder_buffer *buffer)
+{
+	struct binder_page_object *obj;
+	struct flat_binder_object *fp;
+	unsigned long addr;
+
+	for (obj = buffer->page_objects; obj; obj = obj->next) {
+		if (obj->mm)
+			continue; /* mapped by an earlier, failed, read */
+		fp = (struct flat_binder_object *)(buffer->data + obj->offset);
+		fp->binder = NULL;
+
+		down_write(&current->mm->mmap_sem);
+		if (proc->vma == NULL) {
+			up_write(&current->mm->mmap_sem);
+			continue;
+		}
+		proc->mapping_object = obj;
+		proc->mapping_task = current;
+		addr = do_mmap(proc->vma->vm_file, 0, obj->nr_pages * PAGE_SIZE,
+			       PROT_READ, MAP_SHARED, BINDER_PAGES_MMAP_OFFSET);
+		proc->mapping_object = NULL;
+		proc->mapping_task = NULL;
+		up_write(&current->mm->mmap_sem);
+
+		if (IS_ERR_VALUE(addr)) {
+			binder_user_error("binder: %d: failed to map %d pages "
+				"for buffer %d, %ld\n", proc->pid,
+				obj->nr_pages, buffer->debug_id, (long)addr);
+			continue;
+		}
+		atomic_inc(&current->mm->mm_count);
+		obj->mm = current->mm;
+		obj->user_addr = addr;
+		fp->binder = (void *)addr;
+	}
+}
+
+/* Drop the page objects of a buffer, unmapping them if the receiver is
+ * the one freeing the buffer. */
+static void binder_put_page_objects(struct binder_proc *proc,
+	struct binder_buffer *buffer)
+{
+	struct binder_page_object *obj;
+	struct vm_area_struct *vma;
+	unsigned long size;
+
+	while ((obj = buffer->page_objects)) {
+		buffer->page_objects = obj->next;
+		size = obj->nr_pages * PAGE_SIZE;
+		proc->page_object_pages -= obj->nr_pages;
+		if (obj->mm && obj->mm == current->mm) {
+			down_write(&current->mm->mmap_sem);
+			vma = find_vma(current->mm, obj->user_addr);
+			if (vma && vma->vm_ops == &binder_pages_vm_ops &&
+			    vma->vm_private_data == obj &&
+			    vma->vm_start == obj->user_addr &&
+			    vma->vm_end == obj->user_addr + size)
+				do_munmap(current->mm, obj->user_addr, size);
+			up_write(&current->mm->mmap_sem);
+		}
+		kref_put(&obj->kref, binder_page_object_release);
 	}
 }
 
@@ -1174,6 +1690,7 @@ static void binder_free_buf(
 	if (binder_debug_mask & BINDER_DEBUG_BUFFER_ALLOC)
 		printk(KERN_INFO "binder: %d: binder_free_buf %p size %zd buffer"
 		       "_size %zd\n", proc->pid, buffer, size, buffer_size);
+	trace_binder_buffer_free(proc->pid, buffer->data, size);
 
 	BUG_ON(buffer->free);
 	BUG_ON(size > buffer_size);
@@ -1188,12 +1705,33 @@ static void binder_free_buf(
 			       "async free %zd\n", proc->pid, size,
 			       proc->free_async_space);
 	}
+	proc->alloc_stats.frees++;
+	proc->alloc_stats.allocated_bytes -= size;
+	binder_put_page_objects(proc, buffer);
 
-	binder_update_page_range(proc, 0,
-		(void *)PAGE_ALIGN((uintptr_t)buffer->data),
-		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK),
-		NULL);
 	rb_erase(&buffer->rb_node, &proc->allocated_buffers);
+	if (buffer_size < BINDER_QUICK_MAX * 2 &&
+	    buffer_size >= (1U << BINDER_QUICK_MIN_SHIFT)) {
+		int qclass = fls(buffer_size) - 1 - BINDER_QUICK_MIN_SHIFT;
+		if (proc->quick_count[qclass] < binder_quick_depth) {
+			/* stays allocated as far as the neighbours know */
+			list_add(&buffer->quick_entry,
+				 &proc->quick_buffers[qclass]);
+			proc->quick_count[qclass]++;
+			return;
+		}
+	}
+	binder_release_buf_space(proc, buffer);
+}
+
+static void binder_release_buf_space(struct binder_proc *proc,
+	struct binder_buffer *buffer)
+{
+	size_t buffer_size = binder_buffer_size(proc, buffer);
+
+	binder_put_page_range(proc,
+		(void *)PAGE_ALIGN((uintptr_t)buffer->data),
+		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK));
 	buffer->free = 1;
 	if (!list_is_last(&buffer->entry, &proc->buffers)) {
 		struct binder_buffer *next = list_entry(buffer->entry.next,
@@ -1328,7 +1866,7 @@ binder_dec_node(struct binder_node *node, int strong, int internal)
 	if (node->proc && (node->has_strong_ref || node->has_weak_ref)) {
 		if (list_empty(&node->work.entry)) {
 			list_add_tail(&node->work.entry, &node->proc->todo);
-			wake_up_interruptible(&node->proc->wait);
+			binder_wakeup_proc(node->proc);
 		}
 	} else {
 		if (hlist_empty(&node->refs) && !node->local_strong_refs &&
@@ -1524,6 +2062,8 @@ static void
 binder_pop_transaction(
 	struct binder_thread *target_thread, struct binder_transaction *t)
 {
+	if (t->to_thread)
+		binder_restore_policy(t->to_thread->task, t);
 	if (target_thread) {
 		BUG_ON(target_thread->transaction_stack != t);
 		BUG_ON(target_thread->transaction_stack->from != target_thread);
@@ -1610,6 +2150,9 @@ binder_transaction(struct binder_proc *proc, struct binder_thread *thread,
 	struct binder_transaction *in_reply_to = NULL;
 	struct binder_transaction_log_entry *e;
 	uint32_t return_error;
+	unsigned long data_failed, offsets_failed;
+	struct binder_page_object *pinned = NULL;
+	int pin_failed = 0;
 
 	e = binder_transaction_log_add(&binder_transaction_log);
 	e->call_type = reply ? 2 : !!(tr->flags & TF_ONE_WAY);
@@ -1628,7 +2171,17 @@ binder_transaction(struct binder_proc *proc, struct binder_thread *thread,
 			return_error = BR_FAILED_REPLY;
 			goto err_empty_call_stack;
 		}
+		binder_restore_policy(current, in_reply_to);
 		binder_set_nice(in_reply_to->saved_priority);
+		if (in_reply_to->to_thread == thread) {
+			s64 us = ktime_us_delta(ktime_get(),
+						in_reply_to->deliver_time);
+
+			binder_latency_add(&proc->reply_latency, us);
+			trace_binder_transaction_replied(in_reply_to->debug_id,
+							 proc->pid, thread->pid,
+							 us);
+		}
 		if (in_reply_to->to_thread != thread) {
 			binder_user_error("binder: %d:%d got reply transaction "
 				"with bad transaction stack,"
@@ -1763,6 +2316,9 @@ binder_transaction(struct binder_proc *proc, struct binder_thread *thread,
 	t->code = tr->code;
 	t->flags = tr->flags;
 	t->priority = task_nice(current);
+	t->policy = current->policy;
+	t->rt_priority = current->rt_priority;
+	t->saved_policy = -1;
 	t->buffer = binder_alloc_buf(target_proc, tr->data_size,
 		tr->offsets_size, !reply && (t->flags & TF_ONE_WAY));
 	if (t->buffer == NULL) {
@@ -1778,18 +2334,80 @@ binder_transaction(struct binder_proc *proc, struct binder_thread *thread,
 
 	offp = (size_t *)(t->buffer->data + ALIGN(tr->data_size, sizeof(void *)));
 
-	if (copy_from_user(t->buffer->data, tr->data.ptr.buffer, tr->data_size)) {
+	/*
+	 * Copy the payload without binder_main_lock, so large transactions
+	 * and page faults on the sender's data do not stall every other
+	 * binder user. Nobody else can see t->buffer yet and tmp_ref keeps
+	 * target_proc from being released; the target thread can go away,
+	 * so it is looked up again below.
+	 */
+	target_proc->tmp_ref++;
+	mutex_unlock(&binder_main_lock);
+	data_failed = copy_from_user(t->buffer->data, tr->data.ptr.buffer,
+				     tr->data_size);
+	offsets_failed = !data_failed &&
+		copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size);
+	if (!data_failed && !offsets_failed)
+		pin_failed = binder_pin_page_objects(t->buffer, offp,
+						     tr->offsets_size, &pinned);
+	mutex_lock(&binder_main_lock);
+	if (--target_proc->tmp_ref == 0)
+		wake_up(&binder_tmp_ref_wait);
+
+	if (data_failed) {
 		binder_user_error("binder: %d:%d got transaction with invalid "
 			"data ptr\n", proc->pid, thread->pid);
 		return_error = BR_FAILED_REPLY;
 		goto err_copy_data_failed;
 	}
-	if (copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size)) {
+	if (offsets_failed) {
 		binder_user_error("binder: %d:%d got transaction with invalid "
 			"offsets ptr\n", proc->pid, thread->pid);
 		return_error = BR_FAILED_REPLY;
 		goto err_copy_data_failed;
 	}
+	if (pin_failed) {
+		binder_user_error("binder: %d:%d got transaction with invalid "
+			"or too many page objects, %d\n",
+			proc->pid, thread->pid, pin_failed);
+		return_error = BR_FAILED_REPLY;
+		goto err_copy_data_failed;
+	}
+	if (reply) {
+		target_thread = in_reply_to->from;
+		if (target_thread == NULL) {
+			return_error = BR_DEAD_REPLY;
+			goto err_copy_data_failed;
+		}
+		if (target_thread->transaction_stack != in_reply_to) {
+			binder_user_error("binder: %d:%d got reply transaction "
+				"with bad target transaction stack %d, "
+				"expected %d\n",
+				proc->pid, thread->pid,
+				target_thread->transaction_stack ?
+				target_thread->transaction_stack->debug_id : 0,
+				in_reply_to->debug_id);
+			return_error = BR_FAILED_REPLY;
+			in_reply_to = NULL;
+			target_thread = NULL;
+			goto err_copy_data_failed;
+		}
+	} else if (target_thread) {
+		struct binder_transaction *tmp;
+
+		target_thread = NULL;
+		for (tmp = thread->transaction_stack; tmp; tmp = tmp->from_parent)
+			if (tmp->from && tmp->from->proc == target_proc)
+				target_thread = tmp->from;
+		t->to_thread = target_thread;
+		if (target_thread) {
+			target_list = &target_thread->todo;
+			target_wait = &target_thread->wait;
+		} else {
+			target_list = &target_proc->todo;
+			target_wait = &target_proc->wait;
+		}
+	}
 	if (!IS_ALIGNED(tr->offsets_size, sizeof(size_t))) {
 		binder_user_error("binder: %d:%d got transaction with "
 			"invalid offsets size, %zd\n",
@@ -1922,6 +2540,35 @@ binder_transaction(struct binder_proc *proc, struct binder_thread *thread,
 			fp->handle = target_fd;
 		} break;
 
+		case BINDER_TYPE_PAGES: {
+			struct binder_page_object *obj;
+
+			obj = binder_take_page_object(&pinned, *offp);
+			if (obj == NULL) {
+				binder_user_error("binder: %d:%d got transaction with invalid page range, %p size %zd\n",
+					proc->pid, thread->pid, fp->binder, (size_t)fp->cookie);
+				return_error = BR_FAILED_REPLY;
+				goto err_get_page_object_failed;
+			}
+			if (target_proc->page_object_pages + obj->nr_pages >
+			    BINDER_MAX_PROC_PAGES) {
+				binder_user_error("binder: %d:%d page object of %d pages exceeds the limit of %d:%d, %d pinned\n",
+					proc->pid, thread->pid, obj->nr_pages,
+					target_proc->pid, BINDER_MAX_PROC_PAGES,
+					target_proc->page_object_pages);
+				kref_put(&obj->kref, binder_page_object_release);
+				return_error = BR_FAILED_REPLY;
+				goto err_get_page_object_failed;
+			}
+			target_proc->page_object_pages += obj->nr_pages;
+			if (binder_debug_mask & BINDER_DEBUG_TRANSACTION)
+				printk(KERN_INFO "        pages %p-%p\n", fp->binder,
+				       fp->binder + obj->nr_pages * PAGE_SIZE);
+			obj->next = t->buffer->page_objects;
+			t->buffer->page_objects = obj;
+			fp->binder = NULL; /* set on delivery */
+		} break;
+
 		default:
 			binder_user_error("binder: %d:%d got transactio"
 				"n with invalid object type, %lx\n",
@@ -1930,6 +2577,17 @@ binder_transaction(struct binder_proc *proc, struct binder_thread *thread,
 			goto err_bad_object_type;
 		}
 	}
+	/*
+	 * Every object pinned in the unlocked pass must have been claimed
+	 * above. Leftovers mean earlier objects were rewritten over a page
+	 * object, e.g. by a handle to binder translation.
+	 */
+	if (pinned) {
+		binder_user_error("binder: %d:%d got transaction with overlapping page objects\n",
+			proc->pid, thread->pid);
+		return_error = BR_FAILED_REPLY;
+		goto err_get_page_object_failed;
+	}
 	if (reply) {
 		BUG_ON(t->buffer->async_transaction != 0);
 		binder_pop_transaction(target_thread, in_reply_to);
@@ -1948,13 +2606,21 @@ binder_transaction(struct binder_proc *proc, struct binder_thread *thread,
 			target_node->has_async_transaction = 1;
 	}
 	t->work.type = BINDER_WORK_TRANSACTION;
+	t->queue_time = ktime_get();
 	list_add_tail(&t->work.entry, target_list);
+	trace_binder_transaction_queued(t->debug_id, reply, proc->pid,
+					thread->pid, target_proc->pid,
+					target_thread ? target_thread->pid : 0,
+					t->code, t->flags);
 	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
 	list_add_tail(&tcomplete->entry, &thread->todo);
-	if (target_wait)
+	if (target_wait == &target_proc->wait)
+		binder_wakeup_proc(target_proc);
+	else if (target_wait)
 		wake_up_interruptible(target_wait);
 	return;
 
+err_get_page_object_failed:
 err_get_unused_fd_failed:
 err_fget_failed:
 err_fd_not_allowed:
@@ -1964,6 +2630,7 @@ err_binder_new_node_failed:
 err_bad_object_type:
 err_bad_offset:
 err_copy_data_failed:
+	binder_unpin_page_objects(pinned);
 	binder_transaction_buffer_release(target_proc, t->buffer, offp);
 	t->buffer->transaction = NULL;
 	binder_free_buf(target_proc, t->buffer);
@@ -2061,6 +2728,10 @@ binder_transaction_buffer_release(struct binder_proc *proc, struct binder_buffer
 				task_close_fd(proc, fp->handle);
 			break;
 
+		case BINDER_TYPE_PAGES:
+			/* dropped in binder_free_buf() */
+			break;
+
 		default:
 			printk(KERN_ERR "binder: transaction release %d bad object type %lx\n", debug_id, fp->type);
 			break;
@@ -2366,7 +3037,7 @@ binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 						list_add_tail(&ref->death->work.entry, &thread->todo);
 					} else {
 						list_add_tail(&ref->death->work.entry, &proc->todo);
-						wake_up_interruptible(&proc->wait);
+						binder_wakeup_proc(proc);
 					}
 				}
 			} else {
@@ -2396,7 +3067,7 @@ binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 						list_add_tail(&death->work.entry, &thread->todo);
 					} else {
 						list_add_tail(&death->work.entry, &proc->todo);
-						wake_up_interruptible(&proc->wait);
+						binder_wakeup_proc(proc);
 					}
 				} else {
 					BUG_ON(death->work.type != BINDER_WORK_DEAD_BINDER);
@@ -2436,7 +3107,7 @@ binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 					list_add_tail(&death->work.entry, &thread->todo);
 				} else {
 					list_add_tail(&death->work.entry, &proc->todo);
-					wake_up_interruptible(&proc->wait);
+					binder_wakeup_proc(proc);
 				}
 			}
 		} break;
@@ -2473,6 +3144,19 @@ binder_has_thread_work(struct binder_thread *thread)
 		(thread->looper & BINDER_LOOPER_STATE_NEED_RETURN);
 }
 
+/* Number of transactions queued on proc->todo, counting up to max */
+static int binder_proc_backlog(struct binder_proc *proc, int max)
+{
+	struct binder_work *w;
+	int count = 0;
+
+	list_for_each_entry(w, &proc->todo, entry) {
+		if (w->type == BINDER_WORK_TRANSACTION && ++count >= max)
+			break;
+	}
+	return count;
+}
+
 static int
 binder_thread_read(struct binder_proc *proc, struct binder_thread *thread,
 	void  __user *buffer, int size, signed long *consumed, int non_block)
@@ -2510,9 +3194,11 @@ retry:
 
 
 	thread->looper |= BINDER_LOOPER_STATE_WAITING;
-	if (wait_for_proc_work)
+	if (wait_for_proc_work) {
 		proc->ready_threads++;
-	mutex_unlock(&binder_lock);
+		list_add(&thread->waiting_thread_node, &proc->waiting_threads);
+	}
+	mutex_unlock(&binder_main_lock);
 	if (wait_for_proc_work) {
 		if (!(thread->looper & (BINDER_LOOPER_STATE_REGISTERED |
 					BINDER_LOOPER_STATE_ENTERED))) {
@@ -2527,7 +3213,9 @@ retry:
 			if (!binder_has_proc_work(proc, thread))
 				ret = -EAGAIN;
 		} else
-			ret = wait_event_interruptible_exclusive(proc->wait, binder_has_proc_work(proc, thread));
+			ret = wait_event_interruptible(thread->wait,
+				binder_has_proc_work(proc, thread) ||
+				binder_has_thread_work(thread));
 	} else {
 		if (non_block) {
 			if (!binder_has_thread_work(thread))
@@ -2535,9 +3223,11 @@ retry:
 		} else
 			ret = wait_event_interruptible(thread->wait, binder_has_thread_work(thread));
 	}
-	mutex_lock(&binder_lock);
-	if (wait_for_proc_work)
+	mutex_lock(&binder_main_lock);
+	if (wait_for_proc_work) {
 		proc->ready_threads--;
+		list_del_init(&thread->waiting_thread_node);
+	}
 	thread->looper &= ~BINDER_LOOPER_STATE_WAITING;
 
 	if (ret)
@@ -2682,6 +3372,16 @@ retry:
 			tr.target.ptr = target_node->ptr;
 			tr.cookie =  target_node->cookie;
 			t->saved_priority = task_nice(current);
+			if (!(t->flags & TF_ONE_WAY) &&
+			    binder_is_rt_policy(t->policy) &&
+			    (!rt_task(current) ||
+			     current->rt_priority < t->rt_priority)) {
+				/* real-time caller, run at its priority */
+				t->saved_policy = current->policy;
+				t->saved_rt_priority = current->rt_priority;
+				binder_set_policy(current, t->policy,
+						  t->rt_priority);
+			}
 			if (t->priority < target_node->min_priority &&
 			    !(t->flags & TF_ONE_WAY))
 				binder_set_nice(t->priority);
@@ -2705,16 +3405,21 @@ retry:
 			tr.sender_pid = 0;
 		}
 
+		if (t->buffer->page_objects)
+			binder_map_page_objects(proc, t->buffer);
+
 		tr.data_size = t->buffer->data_size;
 		tr.offsets_size = t->buffer->offsets_size;
 		tr.data.ptr.buffer = (void *)t->buffer->data + proc->user_buffer_offset;
 		tr.data.ptr.offsets = tr.data.ptr.buffer + ALIGN(t->buffer->data_size, sizeof(void *));
 
-		if (put_user(cmd, (uint32_t __user *)ptr))
+		if (put_user(cmd, (uint32_t __user *)ptr) ||
+		    copy_to_user(ptr + sizeof(uint32_t), &tr, sizeof(tr))) {
+			/* not delivered, it stays queued */
+			binder_restore_policy(current, t);
 			return -EFAULT;
+		}
 		ptr += sizeof(uint32_t);
-		if (copy_to_user(ptr, &tr, sizeof(tr)))
-			return -EFAULT;
 		ptr += sizeof(tr);
 
 		binder_stat_br(proc, thread, cmd);
@@ -2730,6 +3435,14 @@ retry:
 
 		list_del(&t->work.entry);
 		t->buffer->allow_user_free = 1;
+		t->deliver_time = ktime_get();
+		{
+			s64 us = ktime_us_delta(t->deliver_time, t->queue_time);
+
+			binder_latency_add(&proc->deliver_latency, us);
+			trace_binder_transaction_dequeued(t->debug_id, proc->pid,
+							  thread->pid, us);
+		}
 		if (cmd == BR_TRANSACTION && !(t->flags & TF_ONE_WAY)) {
 			t->to_parent = thread->transaction_stack;
 			t->to_thread = thread;
@@ -2745,7 +3458,10 @@ retry:
 done:
 
 	*consumed = ptr - buffer;
-	if (proc->requested_threads + proc->ready_threads == 0 &&
+	if (proc->requested_threads == 0 &&
+	    (proc->ready_threads == 0 ||
+	     binder_proc_backlog(proc, proc->ready_threads + 1) >
+	     proc->ready_threads) &&
 	    proc->requested_threads_started < proc->max_threads &&
 	    (thread->looper & (BINDER_LOOPER_STATE_REGISTERED |
 	     BINDER_LOOPER_STATE_ENTERED)) /* the user-space code fails to */
@@ -2807,6 +3523,9 @@ static struct binder_thread *binder_get_thread(struct binder_proc *proc)
 		binder_stats.obj_created[BINDER_STAT_THREAD]++;
 		thread->proc = proc;
 		thread->pid = current->pid;
+		get_task_struct(current);
+		thread->task = current;
+		INIT_LIST_HEAD(&thread->waiting_thread_node);
 		init_waitqueue_head(&thread->wait);
 		INIT_LIST_HEAD(&thread->todo);
 		rb_link_node(&thread->rb_node, parent, p);
@@ -2822,6 +3541,7 @@ static int binder_free_thread(struct binder_proc *proc, struct binder_thread *th
 {
 	struct binder_transaction *t;
 	struct binder_transaction *send_reply = NULL;
+	struct binder_transaction *restore = NULL;
 	int active_transactions = 0;
 
 	rb_erase(&thread->rb_node, &proc->threads);
@@ -2834,6 +3554,9 @@ static int binder_free_thread(struct binder_proc *proc, struct binder_thread *th
 			printk(KERN_INFO "binder: release %d:%d transaction %d %s, still active\n",
 			       proc->pid, thread->pid, t->debug_id, (t->to_thread == thread) ? "in" : "out");
 		if (t->to_thread == thread) {
+			/* the oldest inherited policy is the thread's own */
+			if (t->saved_policy >= 0)
+				restore = t;
 			t->to_proc = NULL;
 			t->to_thread = NULL;
 			if (t->buffer) {
@@ -2847,9 +3570,13 @@ static int binder_free_thread(struct binder_proc *proc, struct binder_thread *th
 		} else
 			BUG();
 	}
+	if (restore)
+		binder_restore_policy(thread->task, restore);
 	if (send_reply)
 		binder_send_failed_reply(send_reply, BR_DEAD_REPLY);
 	binder_release_work(&thread->todo);
+	list_del(&thread->waiting_thread_node);
+	put_task_struct(thread->task);
 	kfree(thread);
 	binder_stats.obj_deleted[BINDER_STAT_THREAD]++;
 	return active_transactions;
@@ -2861,12 +3588,12 @@ static unsigned int binder_poll(struct file *filp, struct poll_table_struct *wai
 	struct binder_thread *thread = NULL;
 	int wait_for_proc_work;
 
-	mutex_lock(&binder_lock);
+	mutex_lock(&binder_main_lock);
 	thread = binder_get_thread(proc);
 
 	wait_for_proc_work = thread->transaction_stack == NULL &&
 		list_empty(&thread->todo) && thread->return_error == BR_OK;
-	mutex_unlock(&binder_lock);
+	mutex_unlock(&binder_main_lock);
 
 	if (wait_for_proc_work) {
 		if (binder_has_proc_work(proc, thread))
@@ -2898,7 +3625,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	if (ret)
 		return ret;
 
-	mutex_lock(&binder_lock);
+	mutex_lock(&binder_main_lock);
 	thread = binder_get_thread(proc);
 	if (thread == NULL) {
 		ret = -ENOMEM;
@@ -2931,7 +3658,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		if (bwr.read_size > 0) {
 			ret = binder_thread_read(proc, thread, (void __user *)bwr.read_buffer, bwr.read_size, &bwr.read_consumed, filp->f_flags & O_NONBLOCK);
 			if (!list_empty(&proc->todo))
-				wake_up_interruptible(&proc->wait);
+				binder_wakeup_proc(proc);
 			if (ret < 0) {
 				if (copy_to_user(ubuf, &bwr, sizeof(bwr)))
 					ret = -EFAULT;
@@ -3005,7 +3732,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 err:
 	if (thread)
 		thread->looper &= ~BINDER_LOOPER_STATE_NEED_RETURN;
-	mutex_unlock(&binder_lock);
+	mutex_unlock(&binder_main_lock);
 	wait_event_interruptible(binder_user_error_wait, binder_stop_on_user_error < 2);
 	if (ret && ret != -ERESTARTSYS)
 		printk(KERN_INFO "binder: %d:%d ioctl %x %lx returned %d\n", proc->pid, current->pid, cmd, arg, ret);
@@ -3042,6 +3769,50 @@ static struct vm_operations_struct binder_vm_ops = {
 	.close = binder_vma_close,
 };
 
+static void binder_pages_vma_open(struct vm_area_struct *vma)
+{
+	struct binder_page_object *obj = vma->vm_private_data;
+	kref_get(&obj->kref);
+}
+
+static void binder_pages_vma_close(struct vm_area_struct *vma)
+{
+	struct binder_page_object *obj = vma->vm_private_data;
+	kref_put(&obj->kref, binder_page_object_release);
+}
+
+static struct vm_operations_struct binder_pages_vm_ops = {
+	.open = binder_pages_vma_open,
+	.close = binder_pages_vma_close,
+};
+
+/* Called from binder_map_page_objects() through do_mmap() */
+static int binder_mmap_page_object(struct binder_proc *proc,
+	struct vm_area_struct *vma)
+{
+	struct binder_page_object *obj = proc->mapping_object;
+	unsigned long addr;
+	int i, ret;
+
+	if (obj == NULL || proc->mapping_task != current ||
+	    vma->vm_end - vma->vm_start != obj->nr_pages * PAGE_SIZE ||
+	    (vma->vm_flags & FORBIDDEN_MMAP_FLAGS))
+		return -EINVAL;
+	vma->vm_flags = (vma->vm_flags | VM_DONTCOPY) & ~VM_MAYWRITE;
+
+	for (i = 0, addr = vma->vm_start; i < obj->nr_pages;
+	     i++, addr += PAGE_SIZE) {
+		ret = remap_pfn_range(vma, addr, page_to_pfn(obj->pages[i]),
+				      PAGE_SIZE, vma->vm_page_prot);
+		if (ret)
+			return ret;
+	}
+	vma->vm_ops = &binder_pages_vm_ops;
+	vma->vm_private_data = obj;
+	kref_get(&obj->kref);
+	return 0;
+}
+
 static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 {
 	int ret;
@@ -3050,6 +3821,9 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	const char *failure_string;
 	struct binder_buffer *buffer;
 
+	if (vma->vm_pgoff == BINDER_PAGES_MMAP_OFFSET >> PAGE_SHIFT)
+		return binder_mmap_page_object(proc, vma);
+
 	if ((vma->vm_end - vma->vm_start) > SZ_4M)
 		vma->vm_end = vma->vm_start + SZ_4M;
 
@@ -3096,6 +3870,12 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 		failure_string = "alloc page array";
 		goto err_alloc_pages_failed;
 	}
+	proc->pages_in_use = kzalloc(BITS_TO_LONGS((vma->vm_end - vma->vm_start) / PAGE_SIZE) * sizeof(long), GFP_KERNEL);
+	if (proc->pages_in_use == NULL) {
+		ret = -ENOMEM;
+		failure_string = "alloc page bitmap";
+		goto err_alloc_bitmap_failed;
+	}
 	proc->buffer_size = vma->vm_end - vma->vm_start;
 
 	vma->vm_ops = &binder_vm_ops;
@@ -3120,6 +3900,9 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	return 0;
 
 err_alloc_small_buf_failed:
+	kfree(proc->pages_in_use);
+	proc->pages_in_use = NULL;
+err_alloc_bitmap_failed:
 	kfree(proc->pages);
 	proc->pages = NULL;
 err_alloc_pages_failed:
@@ -3135,6 +3918,7 @@ err_bad_arg:
 static int binder_open(struct inode *nodp, struct file *filp)
 {
 	struct binder_proc *proc;
+	int i;
 
 	if (binder_debug_mask & BINDER_DEBUG_OPEN_CLOSE)
 		printk(KERN_INFO "binder_open: %d:%d\n", current->group_leader->pid, current->pid);
@@ -3147,13 +3931,16 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
 	proc->default_priority = task_nice(current);
-	mutex_lock(&binder_lock);
-	binder_stats.obj_created[BINDER_STAT_PROC]++;
-	hlist_add_head(&proc->proc_node, &binder_procs);
+	INIT_LIST_HEAD(&proc->waiting_threads);
 	proc->pid = current->group_leader->pid;
 	INIT_LIST_HEAD(&proc->delivered_death);
+	for (i = 0; i < BINDER_QUICK_CLASSES; i++)
+		INIT_LIST_HEAD(&proc->quick_buffers[i]);
+	mutex_lock(&binder_procs_lock);
+	binder_stats.obj_created[BINDER_STAT_PROC]++;
+	hlist_add_head(&proc->proc_node, &binder_procs);
+	mutex_unlock(&binder_procs_lock);
 	filp->private_data = proc;
-	mutex_unlock(&binder_lock);
 
 	if (binder_proc_dir_entry_proc) {
 		char strbuf[11];
@@ -3161,6 +3948,12 @@ static int binder_open(struct inode *nodp, struct file *filp)
 		remove_proc_entry(strbuf, binder_proc_dir_entry_proc);
 		create_proc_read_entry(strbuf, S_IRUGO, binder_proc_dir_entry_proc, binder_read_proc_proc, proc);
 	}
+	if (binder_proc_dir_entry_latency) {
+		char strbuf[11];
+		snprintf(strbuf, sizeof(strbuf), "%u", proc->pid);
+		remove_proc_entry(strbuf, binder_proc_dir_entry_latency);
+		create_proc_read_entry(strbuf, S_IRUGO, binder_proc_dir_entry_latency, binder_read_proc_latency, proc);
+	}
 
 	return 0;
 }
@@ -3200,6 +3993,11 @@ static int binder_release(struct inode *nodp, struct file *filp)
 		snprintf(strbuf, sizeof(strbuf), "%u", proc->pid);
 		remove_proc_entry(strbuf, binder_proc_dir_entry_proc);
 	}
+	if (binder_proc_dir_entry_latency) {
+		char strbuf[11];
+		snprintf(strbuf, sizeof(strbuf), "%u", proc->pid);
+		remove_proc_entry(strbuf, binder_proc_dir_entry_latency);
+	}
 
 	binder_defer_work(proc, BINDER_DEFERRED_RELEASE);
 	
@@ -3216,7 +4014,10 @@ static void binder_deferred_release(struct binder_proc *proc)
 	BUG_ON(proc->vma);
 	BUG_ON(proc->files);
 
+	mutex_lock(&binder_procs_lock);
 	hlist_del(&proc->proc_node);
+	binder_stats.obj_deleted[BINDER_STAT_PROC]++;
+	mutex_unlock(&binder_procs_lock);
 	if (binder_context_mgr_node && binder_context_mgr_node->proc == proc) {
 		if (binder_debug_mask & BINDER_DEBUG_DEAD_BINDER)
 			printk(KERN_INFO "binder_release: %d context_mgr_node gone\n", proc->pid);
@@ -3257,7 +4058,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 					if (list_empty(&ref->death->work.entry)) {
 						ref->death->work.type = BINDER_WORK_DEAD_BINDER;
 						list_add_tail(&ref->death->work.entry, &ref->proc->todo);
-						wake_up_interruptible(&ref->proc->wait);
+						binder_wakeup_proc(ref->proc);
 					} else
 						BUG();
 				}
@@ -3288,8 +4089,6 @@ static void binder_deferred_release(struct binder_proc *proc)
 		buffers++;
 	}
 
-	binder_stats.obj_deleted[BINDER_STAT_PROC]++;
-
 	page_count = 0;
 	if (proc->pages) {
 		int i;
@@ -3302,6 +4101,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 			}
 		}
 		kfree(proc->pages);
+		kfree(proc->pages_in_use);
 		vfree(proc->buffer);
 	}
 
@@ -3321,7 +4121,7 @@ static void binder_deferred_func(struct work_struct *work)
 
 	int defer;
 	do {
-		mutex_lock(&binder_lock);
+		mutex_lock(&binder_main_lock);
 		mutex_lock(&binder_deferred_lock);
 		if (!hlist_empty(&binder_deferred_list)) {
 			proc = hlist_entry(binder_deferred_list.first,
@@ -3343,10 +4143,16 @@ static void binder_deferred_func(struct work_struct *work)
 		if (defer & BINDER_DEFERRED_FLUSH)
 			binder_deferred_flush(proc);
 
-		if (defer & BINDER_DEFERRED_RELEASE)
+		if (defer & BINDER_DEFERRED_RELEASE) {
+			while (proc->tmp_ref) {
+				mutex_unlock(&binder_main_lock);
+				wait_event(binder_tmp_ref_wait, proc->tmp_ref == 0);
+				mutex_lock(&binder_main_lock);
+			}
 			binder_deferred_release(proc); /* frees proc */
+		}
 	
-		mutex_unlock(&binder_lock);
+		mutex_unlock(&binder_main_lock);
 		if (files)
 			put_files_struct(files);
 	} while (proc);
@@ -3646,6 +4452,35 @@ static char *print_binder_stats(char *buf, char *end, const char *prefix, struct
 	return buf;
 }
 
+static char *print_binder_alloc_stats(char *buf, char *end, struct binder_proc *proc)
+{
+	struct binder_alloc_stats *st = &proc->alloc_stats;
+	struct rb_node *n;
+	size_t free_space = 0, largest_free = 0, size;
+
+	for (n = rb_first(&proc->free_buffers); n != NULL; n = rb_next(n)) {
+		size = binder_buffer_size(proc, rb_entry(n, struct binder_buffer, rb_node));
+		free_space += size;
+		if (size > largest_free)
+			largest_free = size;
+	}
+	buf += snprintf(buf, end - buf, "  buffer space: size %zd allocated %zd "
+			"free %zd largest free %zd\n", proc->buffer_size,
+			st->allocated_bytes, free_space, largest_free);
+	if (buf >= end)
+		return buf;
+	buf += snprintf(buf, end - buf, "  buffer allocs: %lu frees %lu failed %lu "
+			"quick hits %lu cached %d flushes %lu\n", st->allocs,
+			st->frees, st->failed, st->quick_hits, binder_quick_cached(proc),
+			st->quick_flushes);
+	if (buf >= end)
+		return buf;
+	buf += snprintf(buf, end - buf, "  buffer pages: allocated %lu reused %lu "
+			"freed %lu lazy %d\n", st->pages_allocated,
+			st->pages_reused, st->pages_freed, proc->lazy_pages);
+	return buf;
+}
+
 static char *print_binder_proc_stats(char *buf, char *end, struct binder_proc *proc)
 {
 	struct binder_work *w;
@@ -3691,6 +4526,9 @@ static char *print_binder_proc_stats(char *buf, char *end, struct binder_proc *p
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
 	buf += snprintf(buf, end - buf, "  buffers: %d\n", count);
+	if (buf >= end)
+		return buf;
+	buf = print_binder_alloc_stats(buf, end, proc);
 	if (buf >= end)
 		return buf;
 
@@ -3729,7 +4567,8 @@ static int binder_read_proc_state(
 		return 0;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		mutex_lock(&binder_main_lock);
+	mutex_lock(&binder_procs_lock);
 
 	buf += snprintf(buf, end - buf, "binder state:\n");
 
@@ -3746,8 +4585,9 @@ static int binder_read_proc_state(
 			break;
 		buf = print_binder_proc(buf, end, proc, 1);
 	}
+	mutex_unlock(&binder_procs_lock);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		mutex_unlock(&binder_main_lock);
 	if (buf > page + PAGE_SIZE)
 		buf = page + PAGE_SIZE;
 
@@ -3775,7 +4615,8 @@ static int binder_read_proc_stats(
 		return 0;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		mutex_lock(&binder_main_lock);
+	mutex_lock(&binder_procs_lock);
 
 	p += snprintf(p, PAGE_SIZE, "binder stats:\n");
 
@@ -3786,8 +4627,9 @@ static int binder_read_proc_stats(
 			break;
 		p = print_binder_proc_stats(p, page + PAGE_SIZE, proc);
 	}
+	mutex_unlock(&binder_procs_lock);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		mutex_unlock(&binder_main_lock);
 	if (p > page + PAGE_SIZE)
 		p = page + PAGE_SIZE;
 
@@ -3816,7 +4658,8 @@ static int binder_read_proc_transactions(
 		return 0;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		mutex_lock(&binder_main_lock);
+	mutex_lock(&binder_procs_lock);
 
 	buf += snprintf(buf, end - buf, "binder transactions:\n");
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
@@ -3824,8 +4667,9 @@ static int binder_read_proc_transactions(
 			break;
 		buf = print_binder_proc(buf, end, proc, 0);
 	}
+	mutex_unlock(&binder_procs_lock);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		mutex_unlock(&binder_main_lock);
 	if (buf > page + PAGE_SIZE)
 		buf = page + PAGE_SIZE;
 
@@ -3852,11 +4696,11 @@ static int binder_read_proc_proc(
 		return 0;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		mutex_lock(&binder_main_lock);
 	p += snprintf(p, PAGE_SIZE, "binder proc state:\n");
 	p = print_binder_proc(p, page + PAGE_SIZE, proc, 1);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		mutex_unlock(&binder_main_lock);
 
 	if (p > page + PAGE_SIZE)
 		p = page + PAGE_SIZE;
@@ -3871,6 +4715,61 @@ static int binder_read_proc_proc(
 	return len < count ? len  : count;
 }
 
+static char *print_binder_latency_hist(char *buf, char *end,
+	const char *name, struct binder_latency_hist *hist)
+{
+	int i;
+
+	buf += snprintf(buf, end - buf, "%s:\n", name);
+	for (i = 0; i < BINDER_LATENCY_BUCKETS; i++) {
+		int count = atomic_read(&hist->bucket[i]);
+
+		if (!count)
+			continue;
+		if (i == 0)
+			buf += snprintf(buf, end - buf, "  <1us: %d\n", count);
+		else if (i == BINDER_LATENCY_BUCKETS - 1)
+			buf += snprintf(buf, end - buf, "  >=%luus: %d\n",
+					1UL << (i - 1), count);
+		else
+			buf += snprintf(buf, end - buf, "  %lu-%luus: %d\n",
+					1UL << (i - 1), (1UL << i) - 1, count);
+		if (buf >= end)
+			break;
+	}
+	return buf;
+}
+
+/* Only reads atomic counters, so never takes binder_main_lock */
+static int binder_read_proc_latency(
+	char *page, char **start, off_t off, int count, int *eof, void *data)
+{
+	struct binder_proc *proc = data;
+	int len = 0;
+	char *p = page;
+	char *end = page + PAGE_SIZE;
+
+	if (off)
+		return 0;
+
+	p += snprintf(p, end - p, "binder proc latency: %d\n", proc->pid);
+	p = print_binder_latency_hist(p, end, "deliver", &proc->deliver_latency);
+	if (p < end)
+		p = print_binder_latency_hist(p, end, "reply", &proc->reply_latency);
+
+	if (p > end)
+		p = end;
+	*start = page + off;
+
+	len = p - page;
+	if (len > off)
+		len -= off;
+	else
+		len = 0;
+
+	return len < count ? len  : count;
+}
+
 static char *print_binder_transaction_log_entry(char *buf, char *end, struct binder_transaction_log_entry *e)
 {
 	buf += snprintf(buf, end - buf, "%d: %s from %d:%d to %d:%d node %d handle %d size %d:%d\n",
@@ -3940,6 +4839,8 @@ static int __init binder_init(void)
 	binder_proc_dir_entry_root = proc_mkdir("binder", NULL);
 	if (binder_proc_dir_entry_root)
 		binder_proc_dir_entry_proc = proc_mkdir("proc", binder_proc_dir_entry_root);
+	if (binder_proc_dir_entry_root)
+		binder_proc_dir_entry_latency = proc_mkdir("latency", binder_proc_dir_entry_root);
 	ret = misc_register(&binder_miscdev);
 	if (binder_proc_dir_entry_root) {
 		create_proc_read_entry("state", S_IRUGO, binder_proc_dir_entry_root, binder_read_proc_state, NULL);
@@ -32,6 +32,7 @@ enum {
 	BINDER_TYPE_HANDLE	= B_PACK_CHARS('s', 'h', '*', B_TYPE_LARGE),
 	BINDER_TYPE_WEAK_HANDLE	= B_PACK_CHARS('w', 'h', '*', B_TYPE_LARGE),
 	BINDER_TYPE_FD		= B_PACK_CHARS('f', 'd', '*', B_TYPE_LARGE),
+	BINDER_TYPE_PAGES	= B_PACK_CHARS('p', 'g', '*', B_TYPE_LARGE),
 };
 
 enum {
@@ -61,6 +62,16 @@ struct flat_binder_object {
 	void			*cookie;
 };
 
+/*
+ * BINDER_TYPE_PAGES passes a page aligned range of the sender's memory
+ * (for example an ashmem mapping) without copying it: 'binder' is the
+ * start address and 'cookie' the size in bytes. The pages are mapped
+ * read-only into the receiver when the transaction is delivered and
+ * 'binder' is rewritten to that address, or NULL if the mapping failed.
+ * The mapping goes away with BC_FREE_BUFFER. The sender must not modify
+ * the range until the receiver is done with it.
+ */
+
 /*
  * On 64-bit platforms where user code may run in 32-bits the driver must
  * translate the buffer (and local binder) addresses apropriately.
@@ -19,10 +19,15 @@
 
 #include <linux/module.h>
 #include <linux/fs.h>
+#include <linux/log2.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
 #include <linux/uaccess.h>
 #include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/time.h>
+#include <linux/vmalloc.h>
 #include "logger.h"
 
 #include <asm/ioctls.h>
@@ -32,29 +37,51 @@
  *
  * This structure lives from module insertion until module removal, so it does
  * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * spinlock 'lock'.
+ *
+ * Nothing that can sleep is done under 'lock': writers copy the entry from
+ * user-space into a private buffer first and readers copy out through their
+ * own buffer, so the lock is only held for a memcpy() into or out of the ring
+ * and writers never wait behind a reader that is faulting or sleeping.
+ *
+ * Short entries are built on the writer's stack. Longer ones go through
+ * 'write_buf', serialized by 'write_mutex', which only other long writers
+ * ever wait for.
+ *
+ * The buffer is preceded by a page holding a struct logger_mmap_header, and
+ * both can be mapped read-only by readers. 'mmap_mutex' keeps the buffer from
+ * being replaced by a resize while it is being mapped.
  */
 struct logger_log {
 	unsigned char *		buffer;	/* the ring buffer itself */
+	struct logger_mmap_header * hdr; /* exported offsets, before buffer */
+	struct mutex		mmap_mutex; /* mutex protecting hdr for mmap */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
+	spinlock_t		lock;	/* lock protecting buffer */
+	struct mutex		write_mutex; /* mutex protecting write_buf */
+	unsigned char *		write_buf; /* long entries, LOGGER_ENTRY_MAX_LEN */
 	size_t			w_off;	/* current write head offset */
 	size_t			head;	/* new readers start here */
 	size_t			size;	/* size of the log */
+	unsigned long *		init_size; /* size requested at boot */
 };
 
 /*
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. 'list' and 'r_off' are protected by log->lock; 'mutex'
+ * serializes read() calls on the same file, which share 'buf'.
  */
 struct logger_reader {
 	struct logger_log *	log;	/* associated log */
 	struct list_head	list;	/* entry in logger_log's list */
 	size_t			r_off;	/* current read head offset */
+	struct mutex		mutex;	/* mutex protecting buf */
+	unsigned char *		buf;	/* bounce buffer, LOGGER_ENTRY_MAX_LEN */
+	int			batch;	/* read() returns all entries that fit */
 };
 
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
@@ -87,7 +114,7 @@ static inline struct logger_log * file_get_log(struct file *file)
  * get_entry_len - Grabs the length of the payload of the next entry starting
  * from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->lock.
  */
 static __u32 get_entry_len(struct logger_log *log, size_t off)
 {
@@ -106,15 +133,13 @@ static __u32 get_entry_len(struct logger_log *log, size_t off)
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * do_read_log - reads exactly 'count' bytes from 'log' into the reader's
+ * bounce buffer at 'dst' and advances the reader past them.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static void do_read_log(struct logger_log *log, struct logger_reader *reader,
+			size_t dst, size_t count)
 {
 	size_t len;
 
@@ -124,20 +149,16 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 	 * the log, whichever comes first.
 	 */
 	len = min(count, log->size - reader->r_off);
-	if (copy_to_user(buf, log->buffer + reader->r_off, len))
-		return -EFAULT;
+	memcpy(reader->buf + dst, log->buffer + reader->r_off, len);
 
 	/*
 	 * Second, we read any remaining bytes, starting back at the head of
 	 * the log.
 	 */
 	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
+		memcpy(reader->buf + dst + len, log->buffer, count - len);
 
 	reader->r_off = logger_offset(reader->r_off + count);
-
-	return count;
 }
 
 /*
@@ -147,7 +168,8 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
  *
  * 	- O_NONBLOCK works
  * 	- If there are no log entries to read, blocks until log is written to
- * 	- Atomically reads exactly one log entry
+ * 	- Atomically reads exactly one log entry, or in batch mode (see
+ * 	  LOGGER_SET_BATCH_READ) as many whole entries as fit in 'count'
  *
  * Optimal read size is LOGGER_ENTRY_MAX_LEN. Will set errno to EINVAL if read
  * buffer is insufficient to hold next entry.
@@ -157,6 +179,7 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	size_t copied = 0;
 	ssize_t ret;
 	DEFINE_WAIT(wait);
 
@@ -164,9 +187,9 @@ start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 		if (!ret)
 			break;
 
@@ -187,26 +210,63 @@ start:
 	if (ret)
 		return ret;
 
-	mutex_lock(&log->mutex);
+	mutex_lock(&reader->mutex);
+	spin_lock(&log->lock);
 
 	/* is there still something to read or did we race? */
 	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
+		mutex_unlock(&reader->mutex);
 		goto start;
 	}
 
 	/* get the size of the next entry */
 	ret = get_entry_len(log, reader->r_off);
 	if (count < ret) {
+		spin_unlock(&log->lock);
 		ret = -EINVAL;
 		goto out;
 	}
 
-	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	/*
+	 * Gather whole entries into the bounce buffer under the lock and copy
+	 * them out after dropping it, until 'count' is used up or the log is
+	 * drained. Without batch mode this is exactly one entry.
+	 */
+	while (1) {
+		size_t len = 0;
+
+		while (log->w_off != reader->r_off) {
+			size_t n = get_entry_len(log, reader->r_off);
+
+			if (copied + len + n > count ||
+			    len + n > LOGGER_ENTRY_MAX_LEN)
+				break;
+			do_read_log(log, reader, len, n);
+			len += n;
+			if (!reader->batch)
+				break;
+		}
+		spin_unlock(&log->lock);
+
+		if (!len)
+			break;
+		if (copy_to_user(buf + copied, reader->buf, len)) {
+			if (copied)
+				break;
+			ret = -EFAULT;
+			goto out;
+		}
+		copied += len;
+		if (!reader->batch)
+			break;
+
+		spin_lock(&log->lock);
+	}
+	ret = copied;
 
 out:
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->mutex);
 
 	return ret;
 }
@@ -215,7 +275,7 @@ out:
  * get_next_entry - return the offset of the first valid entry at least 'len'
  * bytes after 'off'.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
 static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
 {
@@ -253,7 +313,7 @@ static inline int clock_interval(size_t a, size_t b, size_t c)
  * We do this by "pulling forward" the readers and start head to the first
  * entry after the new write head.
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void fix_up_readers(struct logger_log *log, size_t len)
 {
@@ -272,7 +332,7 @@ static void fix_up_readers(struct logger_log *log, size_t len)
 /*
  * do_write_log - writes 'len' bytes from 'buf' to 'log'
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void do_write_log(struct logger_log *log, const void *buf, size_t count)
 {
@@ -289,29 +349,46 @@ static void do_write_log(struct logger_log *log, const void *buf, size_t count)
 }
 
 /*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
- *
- * The caller needs to hold log->mutex.
+ * Entries up to this size, header included, are built on the stack.
+ */
+#define LOGGER_STACK_ENTRY_LEN	256
+
+/*
+ * do_write_entry - stamps 'entry' and commits it to 'log'
  *
- * Returns 'count' on success, negative error code on failure.
+ * The entry has already been copied in from user-space, so the lock is only
+ * held for a memcpy().
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
-				      const void __user *buf, size_t count)
+static void do_write_entry(struct logger_log *log, struct logger_entry *entry)
 {
-	size_t len;
+	size_t count = sizeof(struct logger_entry) + entry->len;
+	struct timespec now;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
-		return -EFAULT;
+	spin_lock(&log->lock);
 
-	if (count != len)
-		if (copy_from_user(log->buffer, buf + len, count - len))
-			return -EFAULT;
+	/* stamp under the lock so entries are in timestamp order */
+	now = current_kernel_time();
+	entry->sec = now.tv_sec;
+	entry->nsec = now.tv_nsec;
 
-	log->w_off = logger_offset(log->w_off + count);
+	/*
+	 * Fix up any readers, pulling them forward to the first readable
+	 * entry after (what will be) the new write offset.
+	 */
+	fix_up_readers(log, count);
+
+	/*
+	 * mmap readers check 'head' after copying an entry, so it must be
+	 * visible before the old entries are overwritten, and 'w_off' only
+	 * once the new entry is complete.
+	 */
+	log->hdr->head = log->head;
+	smp_wmb();
+	do_write_log(log, entry, count);
+	smp_wmb();
+	log->hdr->w_off = log->w_off;
 
-	return count;
+	spin_unlock(&log->lock);
 }
 
 /*
@@ -323,59 +400,57 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
-	struct logger_entry header;
-	struct timespec now;
+	unsigned char stack_buf[LOGGER_STACK_ENTRY_LEN] __aligned(4);
+	struct logger_entry *entry;
+	size_t len;
 	ssize_t ret = 0;
 
-	now = current_kernel_time();
-
-	header.pid = current->tgid;
-	header.tid = current->pid;
-	header.sec = now.tv_sec;
-	header.nsec = now.tv_nsec;
-	header.len = min_t(size_t, iocb->ki_left, LOGGER_ENTRY_MAX_PAYLOAD);
+	len = min_t(size_t, iocb->ki_left, LOGGER_ENTRY_MAX_PAYLOAD);
 
 	/* null writes succeed, return zero */
-	if (unlikely(!header.len))
+	if (unlikely(!len))
 		return 0;
 
-	mutex_lock(&log->mutex);
-
 	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
+	 * Build the whole entry outside the lock, so a page fault on the
+	 * user buffer never holds up other writers or readers.
 	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
+	if (sizeof(struct logger_entry) + len <= sizeof(stack_buf))
+		entry = (struct logger_entry *) stack_buf;
+	else {
+		mutex_lock(&log->write_mutex);
+		entry = (struct logger_entry *) log->write_buf;
+	}
 
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	entry->len = len;
+	entry->__pad = 0;
+	entry->pid = current->tgid;
+	entry->tid = current->pid;
 
-	while (nr_segs-- > 0) {
-		size_t len;
-		ssize_t nr;
+	while (nr_segs-- > 0 && ret < len) {
+		size_t seg;
 
 		/* figure out how much of this vector we can keep */
-		len = min_t(size_t, iov->iov_len, header.len - ret);
-
-		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
-		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
+		seg = min_t(size_t, iov->iov_len, len - ret);
+
+		if (copy_from_user(entry->msg + ret, iov->iov_base, seg)) {
+			ret = -EFAULT;
+			goto out;
 		}
 
 		iov++;
-		ret += nr;
+		ret += seg;
 	}
 
-	mutex_unlock(&log->mutex);
+	do_write_entry(log, entry);
 
 	/* wake up any blocked readers */
 	wake_up_interruptible(&log->wq);
 
+out:
+	if (entry != (struct logger_entry *) stack_buf)
+		mutex_unlock(&log->write_mutex);
+
 	return ret;
 }
 
@@ -406,13 +481,20 @@ static int logger_open(struct inode *inode, struct file *file)
 		if (!reader)
 			return -ENOMEM;
 
+		reader->buf = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+		if (!reader->buf) {
+			kfree(reader);
+			return -ENOMEM;
+		}
+
 		reader->log = log;
+		mutex_init(&reader->mutex);
 		INIT_LIST_HEAD(&reader->list);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		reader->r_off = log->head;
 		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
 		file->private_data = reader;
 	} else
@@ -430,7 +512,12 @@ static int logger_release(struct inode *ignored, struct file *file)
 {
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader = file->private_data;
+		struct logger_log *log = reader->log;
+
+		spin_lock(&log->lock);
 		list_del(&reader->list);
+		spin_unlock(&log->lock);
+		kfree(reader->buf);
 		kfree(reader);
 	}
 
@@ -460,21 +547,122 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 	if (log->w_off != reader->r_off)
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
 
+/*
+ * logger_valid_size - a log must be a power of two, hold several maximum
+ * sized entries and stay well below LONG_MAX.
+ */
+static int logger_valid_size(unsigned long size)
+{
+	return is_power_of_2(size) && size >= LOGGER_MIN_BUF_SIZE &&
+		size <= LOGGER_MAX_BUF_SIZE;
+}
+
+/*
+ * logger_alloc - allocate a mappable buffer of 'size' bytes preceded by its
+ * header page.
+ */
+static struct logger_mmap_header *logger_alloc(unsigned long size)
+{
+	struct logger_mmap_header *hdr;
+
+	hdr = vmalloc_user(size + PAGE_SIZE);
+	if (!hdr)
+		return NULL;
+
+	hdr->size = size;
+	hdr->data_offset = PAGE_SIZE;
+
+	return hdr;
+}
+
+/*
+ * logger_resize - replace the buffer of 'log' with a new one of 'size' bytes,
+ * keeping as many of the newest entries as fit. Readers keep their position
+ * relative to the entries; readers of dropped entries restart at the head.
+ */
+static int logger_resize(struct logger_log *log, unsigned long size)
+{
+	struct logger_reader *reader;
+	struct logger_mmap_header *hdr, *old;
+	unsigned char *buffer;
+	size_t head, used, dropped, len;
+
+	if (!logger_valid_size(size))
+		return -EINVAL;
+
+	hdr = logger_alloc(size);
+	if (!hdr)
+		return -ENOMEM;
+	buffer = (unsigned char *) hdr + PAGE_SIZE;
+
+	mutex_lock(&log->mmap_mutex);
+	spin_lock(&log->lock);
+
+	/* drop the oldest entries until the rest fits with room to spare */
+	head = log->head;
+	used = logger_offset(log->w_off - head);
+	if (used >= size) {
+		head = get_next_entry(log, head, used - size + 1);
+		used = logger_offset(log->w_off - head);
+	}
+	dropped = logger_offset(head - log->head);
+
+	len = min(used, log->size - head);
+	memcpy(buffer, log->buffer + head, len);
+	if (used != len)
+		memcpy(buffer + len, log->buffer, used - len);
+
+	list_for_each_entry(reader, &log->readers, list) {
+		size_t off = logger_offset(reader->r_off - log->head);
+
+		reader->r_off = off < dropped ? 0 : off - dropped;
+	}
+
+	hdr->head = 0;
+	hdr->w_off = used;
+
+	/* existing mappings keep the old pages until they are unmapped */
+	old = log->hdr;
+	old->flags |= LOGGER_MMAP_STALE;
+
+	log->hdr = hdr;
+	log->buffer = buffer;
+	log->size = size;
+	log->head = 0;
+	log->w_off = used;
+
+	spin_unlock(&log->lock);
+	mutex_unlock(&log->mmap_mutex);
+
+	vfree(old);
+
+	return 0;
+}
+
 static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct logger_log *log = file_get_log(file);
 	struct logger_reader *reader;
 	long ret = -ENOTTY;
 
-	mutex_lock(&log->mutex);
+	/* resizing allocates, so it is done outside the lock */
+	if (cmd == LOGGER_SET_LOG_BUF_SIZE) {
+		if (!(file->f_mode & FMODE_WRITE))
+			return -EBADF;
+		if (!capable(CAP_SYS_ADMIN))
+			return -EPERM;
+		return logger_resize(log, arg);
+	}
+
+	spin_lock(&log->lock);
 
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
@@ -510,11 +698,51 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		list_for_each_entry(reader, &log->readers, list)
 			reader->r_off = log->w_off;
 		log->head = log->w_off;
+		log->hdr->head = log->head;
+		ret = 0;
+		break;
+	case LOGGER_SET_BATCH_READ:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		reader->batch = !!arg;
 		ret = 0;
 		break;
 	}
 
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
+
+	return ret;
+}
+
+/*
+ * logger_mmap - the log's mmap file operation
+ *
+ * Maps the header page followed by the ring, read-only. Readers follow
+ * hdr->w_off and must discard an entry if hdr->head has passed it by the time
+ * they are done copying it. After a resize LOGGER_MMAP_STALE is set in the old
+ * header and the log has to be mapped again.
+ */
+static int logger_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct logger_log *log;
+	int ret;
+
+	if (!(file->f_mode & FMODE_READ))
+		return -EBADF;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	if (vma->vm_pgoff)
+		return -EINVAL;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	log = file_get_log(file);
+
+	mutex_lock(&log->mmap_mutex);
+	ret = remap_vmalloc_range(vma, log->hdr, 0);
+	mutex_unlock(&log->mmap_mutex);
 
 	return ret;
 }
@@ -524,6 +752,7 @@ static struct file_operations logger_fops = {
 	.read = logger_read,
 	.aio_write = logger_aio_write,
 	.poll = logger_poll,
+	.mmap = logger_mmap,
 	.unlocked_ioctl = logger_ioctl,
 	.compat_ioctl = logger_ioctl,
 	.open = logger_open,
@@ -531,14 +760,17 @@ static struct file_operations logger_fops = {
 };
 
 /*
- * Defines a log structure with name 'NAME' and a size of 'SIZE' bytes, which
- * must be a power of two, greater than LOGGER_ENTRY_MAX_LEN, and less than
- * LONG_MAX minus LOGGER_ENTRY_MAX_LEN.
+ * Defines a log structure with name 'NAME' and a default size of 'SIZE' bytes,
+ * which must be a power of two between LOGGER_MIN_BUF_SIZE and
+ * LOGGER_MAX_BUF_SIZE. The buffer is allocated at init time; its size can be
+ * overridden with the logger.VAR_size parameter and changed at runtime with
+ * LOGGER_SET_LOG_BUF_SIZE.
  */
 #define DEFINE_LOGGER_DEVICE(VAR, NAME, SIZE) \
-static unsigned char _buf_ ## VAR[SIZE]; \
+static unsigned long VAR ## _size = SIZE; \
+static unsigned char VAR ## _write_buf[LOGGER_ENTRY_MAX_LEN] __aligned(4); \
+module_param_named(VAR ## _size, VAR ## _size, ulong, S_IRUGO); \
 static struct logger_log VAR = { \
-	.buffer = _buf_ ## VAR, \
 	.misc = { \
 		.minor = MISC_DYNAMIC_MINOR, \
 		.name = NAME, \
@@ -547,24 +779,36 @@ static struct logger_log VAR = { \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
-	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
+	.mmap_mutex = __MUTEX_INITIALIZER(VAR .mmap_mutex), \
+	.write_mutex = __MUTEX_INITIALIZER(VAR .write_mutex), \
+	.write_buf = VAR ## _write_buf, \
 	.w_off = 0, \
 	.head = 0, \
-	.size = SIZE, \
+	.init_size = &VAR ## _size, \
 };
 
 DEFINE_LOGGER_DEVICE(log_main, LOGGER_LOG_MAIN, 64*1024)
 DEFINE_LOGGER_DEVICE(log_events, LOGGER_LOG_EVENTS, 256*1024)
 DEFINE_LOGGER_DEVICE(log_radio, LOGGER_LOG_RADIO, 64*1024)
+DEFINE_LOGGER_DEVICE(log_system, LOGGER_LOG_SYSTEM, 64*1024)
+DEFINE_LOGGER_DEVICE(log_crash, LOGGER_LOG_CRASH, 64*1024)
+
+static struct logger_log *logger_logs[] = {
+	&log_main,
+	&log_events,
+	&log_radio,
+	&log_system,
+	&log_crash,
+};
 
 static struct logger_log * get_log_from_minor(int minor)
 {
-	if (log_main.misc.minor == minor)
-		return &log_main;
-	if (log_events.misc.minor == minor)
-		return &log_events;
-	if (log_radio.misc.minor == minor)
-		return &log_radio;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(logger_logs); i++)
+		if (logger_logs[i]->misc.minor == minor)
+			return logger_logs[i];
 	return NULL;
 }
 
@@ -572,10 +816,27 @@ static int __init init_log(struct logger_log *log)
 {
 	int ret;
 
+	if (!logger_valid_size(*log->init_size)) {
+		printk(KERN_WARNING "logger: bad size %lu for log '%s'\n",
+		       *log->init_size, log->misc.name);
+		*log->init_size = roundup_pow_of_two(clamp_t(unsigned long,
+			*log->init_size, LOGGER_MIN_BUF_SIZE,
+			LOGGER_MAX_BUF_SIZE));
+	}
+
+	log->size = *log->init_size;
+	log->hdr = logger_alloc(log->size);
+	if (!log->hdr)
+		return -ENOMEM;
+	log->buffer = (unsigned char *) log->hdr + PAGE_SIZE;
+
 	ret = misc_register(&log->misc);
 	if (unlikely(ret)) {
 		printk(KERN_ERR "logger: failed to register misc "
 		       "device for log '%s'!\n", log->misc.name);
+		vfree(log->hdr);
+		log->hdr = NULL;
+		log->buffer = NULL;
 		return ret;
 	}
 
@@ -587,21 +848,15 @@ static int __init init_log(struct logger_log *log)
 
 static int __init logger_init(void)
 {
-	int ret;
-
-	ret = init_log(&log_main);
-	if (unlikely(ret))
-		goto out;
-
-	ret = init_log(&log_events);
-	if (unlikely(ret))
-		goto out;
+	int ret = 0;
+	int i;
 
-	ret = init_log(&log_radio);
-	if (unlikely(ret))
-		goto out;
+	for (i = 0; i < ARRAY_SIZE(logger_logs); i++) {
+		ret = init_log(logger_logs[i]);
+		if (unlikely(ret))
+			break;
+	}
 
-out:
 	return ret;
 }
 device_initcall(logger_init);
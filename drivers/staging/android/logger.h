@@ -30,19 +30,41 @@ struct logger_entry {
 	char		msg[0];	/* the entry's payload */
 };
 
+/*
+ * struct logger_mmap_header - first page of a log mapped with mmap(); the ring
+ * itself starts 'data_offset' bytes into the mapping. Offsets are into the
+ * ring, entries are laid out as for read() and may wrap around its end.
+ */
+struct logger_mmap_header {
+	__u32		size;		/* size of the ring */
+	__u32		data_offset;	/* offset of the ring in the mapping */
+	__u32		head;		/* oldest entry still in the ring */
+	__u32		w_off;		/* end of the newest entry */
+	__u32		flags;		/* LOGGER_MMAP_* */
+};
+
+#define LOGGER_MMAP_STALE	0x1	/* log was resized, map it again */
+
 #define LOGGER_LOG_RADIO	"log_radio"	/* radio-related messages */
 #define LOGGER_LOG_EVENTS	"log_events"	/* system/hardware events */
 #define LOGGER_LOG_MAIN		"log_main"	/* everything else */
+#define LOGGER_LOG_SYSTEM	"log_system"	/* system/framework messages */
+#define LOGGER_LOG_CRASH	"log_crash"	/* native crash reports */
 
 #define LOGGER_ENTRY_MAX_LEN		(4*1024)
 #define LOGGER_ENTRY_MAX_PAYLOAD	\
 	(LOGGER_ENTRY_MAX_LEN - sizeof(struct logger_entry))
 
+#define LOGGER_MIN_BUF_SIZE		(16*1024)
+#define LOGGER_MAX_BUF_SIZE		(16*1024*1024)
+
 #define __LOGGERIO	0xAE
 
 #define LOGGER_GET_LOG_BUF_SIZE		_IO(__LOGGERIO, 1) /* size of log */
 #define LOGGER_GET_LOG_LEN		_IO(__LOGGERIO, 2) /* used log len */
 #define LOGGER_GET_NEXT_ENTRY_LEN	_IO(__LOGGERIO, 3) /* next entry len */
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) /* flush log */
+#define LOGGER_SET_LOG_BUF_SIZE		_IO(__LOGGERIO, 5) /* resize log */
+#define LOGGER_SET_BATCH_READ		_IO(__LOGGERIO, 6) /* multi-entry read */
 
 #endif /* _LINUX_LOGGER_H */
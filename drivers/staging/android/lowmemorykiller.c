@@ -16,7 +16,9 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/mm.h>
+#include <linux/mutex.h>
 #include <linux/oom.h>
+#include <linux/rcupdate.h>
 #include <linux/sched.h>
 
 static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask);
@@ -41,6 +43,18 @@ static size_t lowmem_minfree[6] = {
 };
 static int lowmem_minfree_size = 4;
 
+/*
+ * The last task we killed, pinned until it has released its memory. No new
+ * victim is picked while it is still exiting, or some reclaim passes would
+ * kill it again and others would kill innocent tasks before its pages are
+ * back. lowmem_deathpending_timeout bounds the wait for a task stuck in exit.
+ */
+static struct task_struct *lowmem_deathpending;
+static unsigned long lowmem_deathpending_timeout;
+
+/* Serializes victim selection; concurrent reclaimers just back off */
+static DEFINE_MUTEX(lowmem_select_lock);
+
 #define lowmem_print(level, x...) do { if(lowmem_debug_level >= (level)) printk(x); } while(0)
 
 module_param_named(cost, lowmem_shrinker.seeks, int, S_IRUGO | S_IWUSR);
@@ -48,6 +62,29 @@ module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size, S_IRUGO | S_IWU
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size, S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
 
+/*
+ * lowmem_kill_pending - returns non-zero while the last victim is still
+ * exiting. Caller must hold lowmem_select_lock.
+ */
+static int lowmem_kill_pending(void)
+{
+	struct task_struct *p = lowmem_deathpending;
+	int pending;
+
+	if (!p)
+		return 0;
+
+	task_lock(p);
+	pending = p->mm != NULL;
+	task_unlock(p);
+	if (pending && time_before_eq(jiffies, lowmem_deathpending_timeout))
+		return 1;
+
+	lowmem_deathpending = NULL;
+	put_task_struct(p);
+	return 0;
+}
+
 static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask)
 {
 	struct task_struct *p;
@@ -56,6 +93,7 @@ static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask)
 	int tasksize;
 	int i;
 	int min_adj = OOM_ADJUST_MAX + 1;
+	int selected_adj = 0;
 	int selected_tasksize = 0;
 	int array_size = ARRAY_SIZE(lowmem_adj);
 	int other_free = global_page_state(NR_FREE_PAGES);
@@ -82,34 +120,70 @@ static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask)
 		return rem;
 	}
 
-	read_lock(&tasklist_lock);
+	if (!mutex_trylock(&lowmem_select_lock)) {
+		lowmem_print(4, "lowmem_shrink %d, %x, busy, return %d\n", nr_to_scan, gfp_mask, rem);
+		return rem;
+	}
+	if (lowmem_kill_pending()) {
+		mutex_unlock(&lowmem_select_lock);
+		lowmem_print(4, "lowmem_shrink %d, %x, kill pending, return %d\n", nr_to_scan, gfp_mask, rem);
+		return rem;
+	}
+
+	/*
+	 * The task list is walked under RCU rather than tasklist_lock, so
+	 * fork and exit are not held up while we scan. Each task's RSS is
+	 * only read when its adj could beat the current selection.
+	 */
+	rcu_read_lock();
 	for_each_process(p) {
-		if (p->oomkilladj < min_adj || !p->mm)
+		int oom_adj = p->oomkilladj;
+
+		if (oom_adj < min_adj)
+			continue;
+		if (selected && oom_adj < selected_adj)
 			continue;
+		task_lock(p);
+		if (!p->mm) {
+			task_unlock(p);
+			continue;
+		}
 		tasksize = get_mm_rss(p->mm);
+		task_unlock(p);
 		if (tasksize <= 0)
 			continue;
-		if (selected) {
-			if (p->oomkilladj < selected->oomkilladj)
-				continue;
-			if (p->oomkilladj == selected->oomkilladj &&
-			    tasksize <= selected_tasksize)
-				continue;
-		}
+		if (selected && oom_adj == selected_adj &&
+		    tasksize <= selected_tasksize)
+			continue;
 		selected = p;
+		selected_adj = oom_adj;
 		selected_tasksize = tasksize;
 		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-		             p->pid, p->comm, p->oomkilladj, tasksize);
+		             p->pid, p->comm, oom_adj, tasksize);
 	}
 	if(selected != NULL) {
 		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
 		             selected->pid, selected->comm,
-		             selected->oomkilladj, selected_tasksize);
-		force_sig(SIGKILL, selected);
+		             selected_adj, selected_tasksize);
+		get_task_struct(selected);
+		lowmem_deathpending = selected;
+		lowmem_deathpending_timeout = jiffies + HZ;
 		rem -= selected_tasksize;
 	}
+	rcu_read_unlock();
+	/*
+	 * The scan did not hold tasklist_lock, so the victim may have been
+	 * reaped since. force_sig() needs its sighand, which release_task()
+	 * only clears under the write lock, together with the pid.
+	 */
+	if (selected != NULL) {
+		read_lock(&tasklist_lock);
+		if (pid_alive(selected))
+			force_sig(SIGKILL, selected);
+		read_unlock(&tasklist_lock);
+	}
+	mutex_unlock(&lowmem_select_lock);
 	lowmem_print(4, "lowmem_shrink %d, %x, return %d\n", nr_to_scan, gfp_mask, rem);
-	read_unlock(&tasklist_lock);
 	return rem;
 }
 
@@ -122,6 +196,8 @@ static int __init lowmem_init(void)
 static void __exit lowmem_exit(void)
 {
 	unregister_shrinker(&lowmem_shrinker);
+	if (lowmem_deathpending)
+		put_task_struct(lowmem_deathpending);
 }
 
 module_init(lowmem_init);
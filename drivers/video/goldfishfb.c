@@ -26,6 +26,8 @@
 #include <linux/interrupt.h>
 #include <linux/ioport.h>
 #include <linux/platform_device.h>
+#include <linux/uaccess.h>
+#include <linux/goldfishfb.h>
 #ifdef CONFIG_ANDROID_POWER
 #include <linux/android_power.h>
 #endif
@@ -46,18 +48,36 @@ enum {
 	FB_SET_BLANK        = 0x18,
 	FB_GET_PHYS_WIDTH   = 0x1c,
 	FB_GET_PHYS_HEIGHT  = 0x20,
+	FB_GET_CAPS         = 0x24,	/* 0 on older emulators */
+	FB_SET_DAMAGE_ADDR  = 0x28,	/* physical address of the rect list */
+	FB_SET_DAMAGE_COUNT = 0x2c,	/* rects for the next FB_SET_BASE, 0 = all */
+
+	FB_CAP_DAMAGE            = 1U << 0,
 
 	FB_INT_VSYNC             = 1U << 0,
 	FB_INT_BASE_UPDATE_DONE  = 1U << 1
 };
 
+/* Number of frames in the framebuffer memory. With three of them the
+ * compositor can render the next frame while one is displayed and
+ * another one is queued. */
+#define GOLDFISH_FB_BUFFERS 3
+
 struct goldfish_fb {
 	void __iomem *reg_base;
 	int irq;
 	spinlock_t lock;
 	wait_queue_head_t wait;
 	int base_update_count;
+	int flip_pending;	/* FB_SET_BASE written, update not done yet */
+	int async_flips;	/* set once FBIO_WAITFORVSYNC has been used */
+	u32 vsync_count;	/* number of vsyncs and completed flips */
+	int vsync_waiters;	/* FB_INT_VSYNC is enabled while non zero */
 	int rotation;
+	int damage_supported;
+	u32 damage_count;	/* valid entries in damage, 0 = full frame */
+	/* read by the emulator when FB_SET_BASE is written */
+	struct goldfishfb_rect damage[GOLDFISHFB_MAX_RECTS];
 	struct fb_info fb;
 	u32			cmap[16];
 #ifdef CONFIG_ANDROID_POWER
@@ -76,6 +96,10 @@ goldfish_fb_interrupt(int irq, void *dev_id)
 	status = readl(fb->reg_base + FB_INT_STATUS);
 	if(status & FB_INT_BASE_UPDATE_DONE) {
 		fb->base_update_count++;
+		fb->flip_pending = 0;
+	}
+	if(status & (FB_INT_BASE_UPDATE_DONE | FB_INT_VSYNC)) {
+		fb->vsync_count++;
 		wake_up(&fb->wait);
 	}
 	spin_unlock_irqrestore(&fb->lock, irq_flags);
@@ -113,7 +137,7 @@ static int goldfish_fb_check_var(struct fb_var_screeninfo *var, struct fb_info *
 		if((var->xres != info->var.yres) ||
 		   (var->yres != info->var.xres) ||
 		   (var->xres_virtual != info->var.yres) ||
-		   (var->yres_virtual > info->var.xres * 2) ||
+		   (var->yres_virtual > info->var.xres * GOLDFISH_FB_BUFFERS) ||
 		   (var->yres_virtual < info->var.xres )) {
 			return -EINVAL;
 		}
@@ -122,7 +146,7 @@ static int goldfish_fb_check_var(struct fb_var_screeninfo *var, struct fb_info *
 		if((var->xres != info->var.xres) ||
 		   (var->yres != info->var.yres) ||
 		   (var->xres_virtual != info->var.xres) ||
-		   (var->yres_virtual > info->var.yres * 2) ||
+		   (var->yres_virtual > info->var.yres * GOLDFISH_FB_BUFFERS) ||
 		   (var->yres_virtual < info->var.yres )) {
 			return -EINVAL;
 		}
@@ -147,22 +171,118 @@ static int goldfish_fb_set_par(struct fb_info *info)
 }
 
 
+/* Queue a flip. Only one flip can be outstanding, so we block if the
+ * previous one has not been picked up by the emulator yet. Clients that
+ * have used FBIO_WAITFORVSYNC wait for completion themselves and get the
+ * flip queued without waiting; everyone else still waits for it, as
+ * double buffered clients draw into the old buffer right after panning. */
 static int goldfish_fb_pan_display(struct fb_var_screeninfo *var, struct fb_info *info)
 {
 	unsigned long irq_flags;
-	int base_update_count;
 	struct goldfish_fb *fb = container_of(info, struct goldfish_fb, fb);
 
+	if(fb->flip_pending) {
+		wait_event_timeout(fb->wait, !fb->flip_pending, HZ / 15);
+		if(fb->flip_pending)
+			printk("goldfish_fb_pan_display: timeout wating for base update\n");
+	}
+
 	spin_lock_irqsave(&fb->lock, irq_flags);
-	base_update_count = fb->base_update_count;
+	fb->flip_pending = 1;
+	if(fb->damage_supported) {
+		writel(fb->damage_count, fb->reg_base + FB_SET_DAMAGE_COUNT);
+		fb->damage_count = 0;
+	}
 	writel(fb->fb.fix.smem_start + fb->fb.var.xres * 2 * var->yoffset, fb->reg_base + FB_SET_BASE);
 	spin_unlock_irqrestore(&fb->lock, irq_flags);
-	wait_event_timeout(fb->wait, fb->base_update_count != base_update_count, HZ / 15);
-	if(fb->base_update_count == base_update_count)
-		printk("goldfish_fb_pan_display: timeout wating for base update\n");
+
+	if(!fb->async_flips) {
+		wait_event_timeout(fb->wait, !fb->flip_pending, HZ / 15);
+		if(fb->flip_pending)
+			printk("goldfish_fb_pan_display: timeout wating for base update\n");
+	}
 	return 0;
 }
 
+static int goldfish_fb_wait_for_vsync(struct goldfish_fb *fb)
+{
+	unsigned long irq_flags;
+	u32 vsync_count;
+	int ret;
+
+	spin_lock_irqsave(&fb->lock, irq_flags);
+	if(fb->vsync_waiters++ == 0)
+		writel(FB_INT_BASE_UPDATE_DONE | FB_INT_VSYNC, fb->reg_base + FB_INT_ENABLE);
+	vsync_count = fb->vsync_count;
+	spin_unlock_irqrestore(&fb->lock, irq_flags);
+
+	ret = wait_event_interruptible_timeout(fb->wait,
+				fb->vsync_count != vsync_count, HZ / 10);
+
+	spin_lock_irqsave(&fb->lock, irq_flags);
+	if(--fb->vsync_waiters == 0)
+		writel(FB_INT_BASE_UPDATE_DONE, fb->reg_base + FB_INT_ENABLE);
+	spin_unlock_irqrestore(&fb->lock, irq_flags);
+
+	if(ret < 0)
+		return ret;
+	return ret ? 0 : -ETIMEDOUT;
+}
+
+static int goldfish_fb_set_damage(struct goldfish_fb *fb, void __user *arg)
+{
+	struct goldfishfb_damage damage;
+	unsigned long irq_flags;
+	u32 i;
+
+	if(copy_from_user(&damage, arg, sizeof(damage)))
+		return -EFAULT;
+	if(damage.count > GOLDFISHFB_MAX_RECTS)
+		return -EINVAL;
+	for(i = 0; i < damage.count; i++) {
+		struct goldfishfb_rect *r = &damage.rects[i];
+		if(r->x >= fb->fb.var.xres || r->width > fb->fb.var.xres - r->x ||
+		   r->y >= fb->fb.var.yres || r->height > fb->fb.var.yres - r->y)
+			return -EINVAL;
+	}
+	if(!fb->damage_supported)
+		return 0;
+
+	/* the emulator may still be reading the list of a queued flip */
+	if(fb->flip_pending)
+		wait_event_timeout(fb->wait, !fb->flip_pending, HZ / 15);
+
+	spin_lock_irqsave(&fb->lock, irq_flags);
+	memcpy(fb->damage, damage.rects, damage.count * sizeof(damage.rects[0]));
+	fb->damage_count = damage.count;
+	spin_unlock_irqrestore(&fb->lock, irq_flags);
+	return 0;
+}
+
+static int goldfish_fb_ioctl(struct fb_info *info, unsigned int cmd, unsigned long arg)
+{
+	struct goldfish_fb *fb = container_of(info, struct goldfish_fb, fb);
+	struct fb_vblank vblank;
+
+	switch(cmd) {
+	case FBIO_WAITFORVSYNC:
+		fb->async_flips = 1;
+		return goldfish_fb_wait_for_vsync(fb);
+
+	case GOLDFISHFB_SET_DAMAGE:
+		return goldfish_fb_set_damage(fb, (void __user *)arg);
+
+	case FBIOGET_VBLANK:
+		memset(&vblank, 0, sizeof(vblank));
+		vblank.flags = FB_VBLANK_HAVE_VSYNC | FB_VBLANK_HAVE_COUNT;
+		vblank.count = fb->vsync_count;
+		if(copy_to_user((void __user *)arg, &vblank, sizeof(vblank)))
+			return -EFAULT;
+		return 0;
+	}
+	return -ENOTTY;
+}
+
 #ifdef CONFIG_ANDROID_POWER
 static void goldfish_fb_early_suspend(android_early_suspend_t *h)
 {
@@ -183,6 +303,7 @@ static struct fb_ops goldfish_fb_ops = {
 	.fb_set_par     = goldfish_fb_set_par,
 	.fb_setcolreg   = goldfish_fb_setcolreg,
 	.fb_pan_display = goldfish_fb_pan_display,
+	.fb_ioctl       = goldfish_fb_ioctl,
 	.fb_fillrect    = cfb_fillrect,
 	.fb_copyarea    = cfb_copyarea,
 	.fb_imageblit   = cfb_imageblit,
@@ -228,6 +349,10 @@ static int goldfish_fb_probe(struct platform_device *pdev)
 
 	width = readl(fb->reg_base + FB_GET_WIDTH);
 	height = readl(fb->reg_base + FB_GET_HEIGHT);
+	if(readl(fb->reg_base + FB_GET_CAPS) & FB_CAP_DAMAGE) {
+		fb->damage_supported = 1;
+		writel(__pa(fb->damage), fb->reg_base + FB_SET_DAMAGE_ADDR);
+	}
 
 	fb->fb.fbops		= &goldfish_fb_ops;
 	fb->fb.flags		= FBINFO_FLAG_DEFAULT;
@@ -242,7 +367,7 @@ static int goldfish_fb_probe(struct platform_device *pdev)
 	fb->fb.var.xres		= width;
 	fb->fb.var.yres		= height;
 	fb->fb.var.xres_virtual	= width;
-	fb->fb.var.yres_virtual	= height * 2;
+	fb->fb.var.yres_virtual	= height * GOLDFISH_FB_BUFFERS;
 	fb->fb.var.bits_per_pixel = 16;
 	fb->fb.var.activate	= FB_ACTIVATE_NOW;
 	fb->fb.var.height	= readl(fb->reg_base + FB_GET_PHYS_HEIGHT);
@@ -256,7 +381,7 @@ static int goldfish_fb_probe(struct platform_device *pdev)
 	fb->fb.var.blue.offset = 0;
 	fb->fb.var.blue.length = 5;
 
-	framesize = width * height * 2 * 2;
+	framesize = width * height * 2 * GOLDFISH_FB_BUFFERS;
 #if defined(CONFIG_ARM)
 	fb->fb.screen_base = dma_alloc_writecombine(&pdev->dev, framesize,
 	                                            &fbpaddr, GFP_KERNEL);
@@ -328,7 +453,7 @@ static int goldfish_fb_remove(struct platform_device *pdev)
 	size_t framesize;
 	struct goldfish_fb *fb = platform_get_drvdata(pdev);
 	
-	framesize = fb->fb.var.xres_virtual * fb->fb.var.yres_virtual * 2;
+	framesize = fb->fb.fix.smem_len;
 
 #ifdef CONFIG_ANDROID_POWER
         android_unregister_early_suspend(&fb->early_suspend);
@@ -51,6 +51,8 @@ extern const char *yaffs_guts_c_version;
 #include <linux/interrupt.h>
 #include <linux/string.h>
 #include <linux/ctype.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 
 #include "asm/div64.h"
 
@@ -169,6 +171,7 @@ static struct inode *yaffs_iget(struct super_block *sb, unsigned long ino);
 		} while(0)
 		
 static void yaffs_put_super(struct super_block *sb);
+static int yaffs_remount_fs(struct super_block *sb, int *flags, char *data);
 
 static ssize_t yaffs_file_write(struct file *f, const char *buf, size_t n,
 				loff_t *pos);
@@ -359,6 +362,7 @@ static const struct super_operations yaffs_super_ops = {
 	.put_inode = yaffs_put_inode,
 #endif
 	.put_super = yaffs_put_super,
+	.remount_fs = yaffs_remount_fs,
 	.delete_inode = yaffs_delete_inode,
 	.clear_inode = yaffs_clear_inode,
 	.sync_fs = yaffs_sync_fs,
@@ -368,14 +372,31 @@ static const struct super_operations yaffs_super_ops = {
 static void yaffs_GrossLock(yaffs_Device *dev)
 {
 	T(YAFFS_TRACE_OS, ("yaffs locking %p\n", current));
-	down(&dev->grossLock);
+	down_write(&dev->grossLock);
 	T(YAFFS_TRACE_OS, ("yaffs locked %p\n", current));
 }
 
 static void yaffs_GrossUnlock(yaffs_Device *dev)
 {
 	T(YAFFS_TRACE_OS, ("yaffs unlocking %p\n", current));
-	up(&dev->grossLock);
+	up_write(&dev->grossLock);
+}
+
+/* Shared locking is only for paths that go through
+ * yaffs_ReadDataFromFileShared(); everything else must use the
+ * exclusive lock above.
+ */
+static void yaffs_GrossLockShared(yaffs_Device *dev)
+{
+	T(YAFFS_TRACE_OS, ("yaffs locking shared %p\n", current));
+	down_read(&dev->grossLock);
+	T(YAFFS_TRACE_OS, ("yaffs locked shared %p\n", current));
+}
+
+static void yaffs_GrossUnlockShared(yaffs_Device *dev)
+{
+	T(YAFFS_TRACE_OS, ("yaffs unlocking shared %p\n", current));
+	up_read(&dev->grossLock);
 }
 
 static int yaffs_readlink(struct dentry *dentry, char __user *buffer,
@@ -624,13 +645,24 @@ static int yaffs_readpage_nolock(struct file *f, struct page *pg)
 	pg_buf = kmap(pg);
 	/* FIXME: Can kmap fail? */
 
-	yaffs_GrossLock(dev);
+	yaffs_GrossLockShared(dev);
 
-	ret = yaffs_ReadDataFromFile(obj, pg_buf,
+	ret = yaffs_ReadDataFromFileShared(obj, pg_buf,
 				pg->index << PAGE_CACHE_SHIFT,
 				PAGE_CACHE_SIZE);
 
-	yaffs_GrossUnlock(dev);
+	yaffs_GrossUnlockShared(dev);
+
+	if (ret < 0) {
+		/* Part of the page has to go through the short-op cache */
+		yaffs_GrossLock(dev);
+
+		ret = yaffs_ReadDataFromFile(obj, pg_buf,
+					pg->index << PAGE_CACHE_SHIFT,
+					PAGE_CACHE_SIZE);
+
+		yaffs_GrossUnlock(dev);
+	}
 
 	if (ret >= 0)
 		ret = 0;
@@ -1710,10 +1742,111 @@ static void yaffs_read_inode(struct inode *inode)
 
 static YLIST_HEAD(yaffs_dev_list);
 
-#if 0 /* not used */
+
+/* Delay between GC steps while there is work to do, and between idle
+ * checks while below the high watermark. Above it the thread sleeps until
+ * a writer wakes it.
+ */
+#define YAFFS_BG_GC_BUSY_DELAY	(HZ / 50)
+#define YAFFS_BG_GC_IDLE_DELAY	HZ
+
+static void yaffs_WakeBackgroundGc(yaffs_Device *dev)
+{
+	if (dev->bgThread)
+		wake_up_process(dev->bgThread);
+}
+
+static int yaffs_BackgroundThread(void *data)
+{
+	yaffs_Device *dev = (yaffs_Device *)data;
+	int lastWrites = dev->nPageWrites;
+	int more;
+	long delay;
+
+	T(YAFFS_TRACE_OS, ("yaffs_BackgroundThread starting\n"));
+
+	set_freezable();
+
+	for (;;) {
+		try_to_freeze();
+
+		yaffs_GrossLock(dev);
+
+		/* Cleared under the lock on the way out, so no writer
+		 * wakes us once we are gone.
+		 */
+		dev->backgroundGcParked = 0;
+		if (kthread_should_stop()) {
+			yaffs_GrossUnlock(dev);
+			break;
+		}
+
+		/* Idle means no pages were written since we last looked,
+		 * not counting our own GC copies.
+		 */
+		more = yaffs_BackgroundGarbageCollect(dev,
+					dev->nPageWrites == lastWrites);
+		lastWrites = dev->nPageWrites;
+
+		if (more)
+			delay = YAFFS_BG_GC_BUSY_DELAY;
+		else if (yaffs_BackgroundGcWanted(dev))
+			delay = YAFFS_BG_GC_IDLE_DELAY;
+		else {
+			delay = MAX_SCHEDULE_TIMEOUT;
+			dev->backgroundGcParked = 1;
+		}
+
+		/* Before unlocking, so a writer's wakeup can't be lost */
+		set_current_state(TASK_INTERRUPTIBLE);
+		yaffs_GrossUnlock(dev);
+
+		if (!kthread_should_stop())
+			schedule_timeout(delay);
+		__set_current_state(TASK_RUNNING);
+	}
+
+	T(YAFFS_TRACE_OS, ("yaffs_BackgroundThread exiting\n"));
+	return 0;
+}
+
+static void yaffs_StartBackgroundThread(yaffs_Device *dev)
+{
+	struct mtd_info *mtd = (struct mtd_info *)dev->genericDevice;
+	struct task_struct *thread;
+
+	if (dev->bgThread || dev->noBackgroundGc)
+		return;
+
+	thread = kthread_run(yaffs_BackgroundThread, dev, "yaffs-gc/%d",
+				mtd->index);
+	if (IS_ERR(thread)) {
+		printk(KERN_WARNING "yaffs: could not start GC thread\n");
+		return;
+	}
+
+	yaffs_GrossLock(dev);
+	dev->bgThread = thread;
+	dev->backgroundGc = 1;
+	yaffs_GrossUnlock(dev);
+}
+
+static void yaffs_StopBackgroundThread(yaffs_Device *dev)
+{
+	if (!dev->bgThread)
+		return;
+
+	kthread_stop(dev->bgThread);
+	dev->bgThread = NULL;
+
+	yaffs_GrossLock(dev);
+	dev->backgroundGc = 0;
+	yaffs_GrossUnlock(dev);
+}
+
 static int yaffs_remount_fs(struct super_block *sb, int *flags, char *data)
 {
-	yaffs_Device    *dev = yaffs_SuperToDevice(sb);
+	yaffs_Device *dev = yaffs_SuperToDevice(sb);
 
 	if (*flags & MS_RDONLY) {
 		struct mtd_info *mtd = yaffs_SuperToDevice(sb)->genericDevice;
@@ -1721,6 +1854,9 @@ static int yaffs_remount_fs(struct super_block *sb, int *flags, char *data)
 		T(YAFFS_TRACE_OS,
 			("yaffs_remount_fs: %s: RO\n", dev->name));
 
+		/* GC would invalidate the checkpoint saved below */
+		yaffs_StopBackgroundThread(dev);
+
 		yaffs_GrossLock(dev);
 
 		yaffs_FlushEntireDeviceCache(dev);
@@ -1734,11 +1870,12 @@ static int yaffs_remount_fs(struct super_block *sb, int *flags, char *data)
 	} else {
 		T(YAFFS_TRACE_OS,
 			("yaffs_remount_fs: %s: RW\n", dev->name));
+
+		yaffs_StartBackgroundThread(dev);
 	}
 
 	return 0;
 }
-#endif
 
 static void yaffs_put_super(struct super_block *sb)
 {
@@ -1746,6 +1883,8 @@ static void yaffs_put_super(struct super_block *sb)
 
 	T(YAFFS_TRACE_OS, ("yaffs_put_super\n"));
 
+	yaffs_StopBackgroundThread(dev);
+
 	yaffs_GrossLock(dev);
 
 	yaffs_FlushEntireDeviceCache(dev);
@@ -1796,6 +1935,8 @@ typedef struct {
 	int skip_checkpoint_read;
 	int skip_checkpoint_write;
 	int no_cache;
+	int cache_size;
+	int no_background_gc;
 } yaffs_options;
 
 #define MAX_OPT_LEN 20
@@ -1823,6 +1964,11 @@ static int yaffs_parse_options(yaffs_options *options, const char *options_str)
 			options->inband_tags = 1;
 		else if (!strcmp(cur_opt, "no-cache"))
 			options->no_cache = 1;
+		else if (!strncmp(cur_opt, "cache-size=", 11))
+			options->cache_size =
+				simple_strtoul(cur_opt + 11, NULL, 10);
+		else if (!strcmp(cur_opt, "no-background-gc"))
+			options->no_background_gc = 1;
 		else if (!strcmp(cur_opt, "no-checkpoint-read"))
 			options->skip_checkpoint_read = 1;
 		else if (!strcmp(cur_opt, "no-checkpoint-write"))
@@ -2034,7 +2180,12 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 	dev->nChunksPerBlock = YAFFS_CHUNKS_PER_BLOCK;
 	dev->totalBytesPerChunk = YAFFS_BYTES_PER_CHUNK;
 	dev->nReservedBlocks = 5;
-	dev->nShortOpCaches = (options.no_cache) ? 0 : 10;
+	if (options.no_cache)
+		dev->nShortOpCaches = 0;
+	else if (options.cache_size > 0)
+		dev->nShortOpCaches = options.cache_size;
+	else
+		dev->nShortOpCaches = YAFFS_DEFAULT_SHORT_OP_CACHES;
 	dev->inbandTags = options.inband_tags;
 
 	/* ... and the functions. */
@@ -2043,6 +2194,7 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 		    nandmtd2_WriteChunkWithTagsToNAND;
 		dev->readChunkWithTagsFromNAND =
 		    nandmtd2_ReadChunkWithTagsFromNAND;
+		dev->readChunkDataShared = nandmtd2_ReadChunkDataShared;
 		dev->markNANDBlockBad = nandmtd2_MarkNANDBlockBad;
 		dev->queryNANDBlock = nandmtd2_QueryNANDBlock;
 		dev->spareBuffer = YMALLOC(mtd->oobsize);
@@ -2081,6 +2233,7 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 
 	dev->superBlock = (void *)sb;
 	dev->markSuperBlockDirty = yaffs_MarkSuperBlockDirty;
+	dev->wakeBackgroundGc = yaffs_WakeBackgroundGc;
 
 
 #ifndef CONFIG_YAFFS_DOES_ECC
@@ -2093,11 +2246,13 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 
 	dev->skipCheckpointRead = options.skip_checkpoint_read;
 	dev->skipCheckpointWrite = options.skip_checkpoint_write;
+	dev->noBackgroundGc = options.no_background_gc;
 
 	/* we assume this is protected by lock_kernel() in mount/umount */
 	ylist_add_tail(&dev->devList, &yaffs_dev_list);
 
-	init_MUTEX(&dev->grossLock);
+	init_rwsem(&dev->grossLock);
+	spin_lock_init(&dev->readLock);
 
 	yaffs_GrossLock(dev);
 
@@ -2133,6 +2288,9 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 	}
 	sb->s_root = root;
 	sb->s_dirt = !dev->isCheckpointed;
+
+	if (!(sb->s_flags & MS_RDONLY))
+		yaffs_StartBackgroundThread(dev);
 	T(YAFFS_TRACE_ALWAYS,
 	  ("yaffs_read_super: isCheckpointed %d\n", dev->isCheckpointed));
 
@@ -2260,6 +2418,8 @@ static char *yaffs_dump_dev(char *buf, yaffs_Device * dev)
 	buf += sprintf(buf, "garbageCollections. %d\n", dev->garbageCollections);
 	buf += sprintf(buf, "passiveGCs......... %d\n",
 		    dev->passiveGarbageCollections);
+	buf += sprintf(buf, "backgroundGCs...... %d\n",
+		    dev->backgroundGarbageCollections);
 	buf += sprintf(buf, "nRetriedWrites..... %d\n", dev->nRetriedWrites);
 	buf += sprintf(buf, "nShortOpCaches..... %d\n", dev->nShortOpCaches);
 	buf += sprintf(buf, "nRetireBlocks...... %d\n", dev->nRetiredBlocks);
@@ -35,6 +35,18 @@ const char *yaffs_guts_c_version =
 
 #define YAFFS_PASSIVE_GC_CHUNKS 2
 
+/* Background GC watermarks. The low watermark sits this many blocks above
+ * the point where writers start collecting aggressively; the high one a
+ * fraction of the device above that.
+ */
+#define YAFFS_BG_GC_LOW_BLOCKS 2
+#define YAFFS_BG_GC_HIGH_FRACTION 16
+
+/* When every cache entry is dirty, write back this fraction of the cache
+ * (oldest first) rather than a single entry.
+ */
+#define YAFFS_CACHE_WRITEBACK_FRACTION 4
+
 #include "yaffs_ecc.h"
 
 
@@ -70,6 +82,8 @@ static int yaffs_UpdateObjectHeader(yaffs_Object *in, const YCHAR *name,
 				int force, int isShrink, int shadows);
 static void yaffs_RemoveObjectFromDirectory(yaffs_Object *obj);
 static int yaffs_CheckStructures(void);
+static void yaffs_NameIndexAdd(yaffs_Object *directory, yaffs_Object *obj);
+static void yaffs_NameIndexRehash(yaffs_Object *obj);
 static int yaffs_DeleteWorker(yaffs_Object *in, yaffs_Tnode *tn, __u32 level,
 			int chunkOffset, int *limit);
 static int yaffs_DoGenericObjectDeletion(yaffs_Object *in);
@@ -1137,6 +1151,7 @@ static void yaffs_SetObjectName(yaffs_Object *obj, const YCHAR *name)
 		obj->shortName[0] = _Y('\0');
 #endif
 	obj->sum = yaffs_CalcNameSum(name);
+	yaffs_NameIndexRehash(obj);
 }
 
 /*-------------------- TNODES -------------------
@@ -1922,12 +1937,14 @@ static yaffs_Object *yaffs_AllocateEmptyObject(yaffs_Device *dev)
 		YINIT_LIST_HEAD(&(tn->hardLinks));
 		YINIT_LIST_HEAD(&(tn->hashLink));
 		YINIT_LIST_HEAD(&tn->siblings);
+		YINIT_LIST_HEAD(&tn->nameLink);
 
 
 		/* Now make the directory sane */
 		if (dev->rootDir) {
 			tn->parent = dev->rootDir;
 			ylist_add(&(tn->siblings), &dev->rootDir->variant.directoryVariant.children);
+			yaffs_NameIndexAdd(dev->rootDir, tn);
 		}
 
 		/* Add it to the lost and found directory.
@@ -2006,6 +2023,15 @@ static void yaffs_FreeObject(yaffs_Object *tn)
 
 	yaffs_UnhashObject(tn);
 
+	/* Clean cache entries outlive flushes; don't let them match a reused object */
+	yaffs_InvalidateWholeChunkCache(tn);
+
+	if (tn->variantType == YAFFS_OBJECT_TYPE_DIRECTORY &&
+	    tn->variant.directoryVariant.nameHash) {
+		YFREE(tn->variant.directoryVariant.nameHash);
+		tn->variant.directoryVariant.nameHash = NULL;
+	}
+
 #ifdef VALGRIND_TEST
 	YFREE(tn);
 #else
@@ -2032,6 +2058,21 @@ static void yaffs_DeinitialiseObjects(yaffs_Device *dev)
 	/* Free the list of allocated Objects */
 
 	yaffs_ObjectList *tmp;
+	struct ylist_head *i;
+	yaffs_Object *obj;
+	int b;
+
+	/* Directory name indexes are allocated separately */
+	for (b = 0; b < YAFFS_NOBJECT_BUCKETS; b++) {
+		ylist_for_each(i, &dev->objectBucket[b].list) {
+			obj = ylist_entry(i, yaffs_Object, hashLink);
+			if (obj->variantType == YAFFS_OBJECT_TYPE_DIRECTORY &&
+			    obj->variant.directoryVariant.nameHash) {
+				YFREE(obj->variant.directoryVariant.nameHash);
+				obj->variant.directoryVariant.nameHash = NULL;
+			}
+		}
+	}
 
 	while (dev->allocatedObjectList) {
 		tmp = dev->allocatedObjectList->next;
@@ -2212,6 +2253,7 @@ yaffs_Object *yaffs_CreateNewObject(yaffs_Device *dev, int number,
 		case YAFFS_OBJECT_TYPE_DIRECTORY:
 			YINIT_LIST_HEAD(&theObject->variant.directoryVariant.
 					children);
+			theObject->variant.directoryVariant.nameHash = NULL;
 			break;
 		case YAFFS_OBJECT_TYPE_SYMLINK:
 		case YAFFS_OBJECT_TYPE_HARDLINK:
@@ -3220,6 +3262,12 @@ static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
 		return YAFFS_OK;
 	}
 
+	/* Erased space is running low, so the background GC has work again */
+	if (dev->backgroundGcParked && yaffs_BackgroundGcWanted(dev)) {
+		dev->backgroundGcParked = 0;
+		dev->wakeBackgroundGc(dev);
+	}
+
 	/* This loop should pass the first time.
 	 * We'll only see looping here if the erase of the collected block fails.
 	 */
@@ -3239,6 +3287,10 @@ static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
 			aggressive = 0;
 		}
 
+		/* Leave leisurely collection to the background thread */
+		if (!aggressive && dev->backgroundGc)
+			return YAFFS_OK;
+
 		if (dev->gcBlock <= 0) {
 			dev->gcBlock = yaffs_FindBlockForGarbageCollection(dev, aggressive);
 			dev->gcChunk = 0;
@@ -3272,6 +3324,92 @@ static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
 	return aggressive ? gcOk : YAFFS_OK;
 }
 
+/* Background GC watermarks, in erased chunks */
+static void yaffs_BackgroundGcWatermarks(yaffs_Device *dev, int *lowWater,
+					int *highWater)
+{
+	int checkpointBlockAdjust;
+
+	checkpointBlockAdjust = yaffs_CalcCheckpointBlocksRequired(dev) - dev->blocksInCheckpoint;
+	if (checkpointBlockAdjust < 0)
+		checkpointBlockAdjust = 0;
+
+	*lowWater = dev->nReservedBlocks + checkpointBlockAdjust + 2 +
+			YAFFS_BG_GC_LOW_BLOCKS;
+	*highWater = *lowWater + (dev->internalEndBlock -
+			dev->internalStartBlock + 1) / YAFFS_BG_GC_HIGH_FRACTION;
+
+	*lowWater *= dev->nChunksPerBlock;
+	*highWater *= dev->nChunksPerBlock;
+}
+
+/* Returns 1 while there are fewer erased chunks than the background GC
+ * aims to keep, or a block is still being collected.
+ */
+int yaffs_BackgroundGcWanted(yaffs_Device *dev)
+{
+	int lowWater;
+	int highWater;
+
+	if (dev->gcBlock > 0)
+		return 1;
+
+	yaffs_BackgroundGcWatermarks(dev, &lowWater, &highWater);
+	return yaffs_GetErasedChunks(dev) < highWater;
+}
+
+/* Garbage collection for an OS background thread, called with the device
+ * locked. Does at most one GC step so the caller can drop the lock in
+ * between. Below the low watermark it collects whether or not the device
+ * is busy, so writers rarely reach the aggressive threshold themselves.
+ * Between the watermarks it only collects if the caller says the device
+ * is idle.
+ * Returns 1 if another step straight away would be useful.
+ */
+int yaffs_BackgroundGarbageCollect(yaffs_Device *dev, int idle)
+{
+	int erasedChunks;
+	int lowWater;
+	int highWater;
+	int aggressive;
+
+	if (dev->isDoingGC || !dev->isMounted)
+		return 0;
+
+	yaffs_BackgroundGcWatermarks(dev, &lowWater, &highWater);
+
+	erasedChunks = yaffs_GetErasedChunks(dev);
+	aggressive = (erasedChunks < lowWater);
+
+	if (dev->gcBlock <= 0) {
+		if (erasedChunks >= highWater || (!aggressive && !idle))
+			return 0;
+
+		/* The skip count only throttles passive GC in the write path */
+		dev->nonAggressiveSkip = 0;
+
+		dev->gcBlock = yaffs_FindBlockForGarbageCollection(dev, aggressive);
+		dev->gcChunk = 0;
+
+		if (dev->gcBlock <= 0)
+			return 0;
+
+		T(YAFFS_TRACE_GC,
+		  (TSTR
+		   ("yaffs: background GC erasedChunks %d aggressive %d" TENDSTR),
+		   erasedChunks, aggressive));
+	}
+
+	dev->garbageCollections++;
+	dev->backgroundGarbageCollections++;
+	if (!aggressive)
+		dev->passiveGarbageCollections++;
+
+	yaffs_GarbageCollectBlock(dev, dev->gcBlock, 0);
+
+	return 1;
+}
+
 /*-------------------------  TAGS --------------------------------*/
 
 static int yaffs_TagsMatch(const yaffs_ExtendedTags *tags, int objectId,
@@ -3802,6 +3940,8 @@ int yaffs_UpdateObjectHeader(yaffs_Object *in, const YCHAR *name, int force,
 		if (newChunkId >= 0) {
 
 			in->hdrChunk = newChunkId;
+			if (prevChunkId <= 0)
+				yaffs_NameIndexRehash(in);	/* name now trusted */
 
 			if (prevChunkId > 0) {
 				yaffs_DeleteChunk(dev, prevChunkId, 1,
@@ -3839,8 +3979,9 @@ int yaffs_UpdateObjectHeader(yaffs_Object *in, const YCHAR *name, int force,
  *   In Linux, the page cache provides read buffering aand the short op cache provides write
  *   buffering.
  *
- *   There are a limited number (~10) of cache chunks per device so that we don't
- *   need a very intelligent search.
+ *   The number of cache chunks is set by the OS layer. Lookups go through a
+ *   hash on (objectId, chunkId) and replacement uses an LRU list, so larger
+ *   caches don't cost a linear search.
  */
 
 static int yaffs_ObjectHasCachedWriteData(yaffs_Object *obj)
@@ -3860,6 +4001,24 @@ static int yaffs_ObjectHasCachedWriteData(yaffs_Object *obj)
 	return 0;
 }
 
+static struct ylist_head *yaffs_ChunkCacheBucket(yaffs_Device *dev,
+					const yaffs_Object *obj, int chunkId)
+{
+	return &dev->srCacheHash[(obj->objectId * 31 + chunkId) &
+				dev->srCacheHashMask];
+}
+
+/* Drop whatever a cache entry holds. Empty entries go to the old end of
+ * the LRU so they are the first to be reused.
+ */
+static void yaffs_ReleaseChunkCache(yaffs_Device *dev, yaffs_ChunkCache *cache)
+{
+	cache->object = NULL;
+	cache->dirty = 0;
+	ylist_del_init(&cache->hashLink);
+	ylist_del(&cache->lruLink);
+	ylist_add_tail(&cache->lruLink, &dev->srCacheLru);
+}
 
 static void yaffs_FlushFilesChunkCache(yaffs_Object *obj)
 {
@@ -3888,7 +4047,7 @@ static void yaffs_FlushFilesChunkCache(yaffs_Object *obj)
 			}
 
 			if (cache && !cache->locked) {
-				/* Write it out and free it up */
+				/* Write it out. The data stays cached, now clean. */
 
 				chunkWritten =
 				    yaffs_WriteChunkDataToObject(cache->object,
@@ -3897,7 +4056,6 @@ static void yaffs_FlushFilesChunkCache(yaffs_Object *obj)
 								 cache->nBytes,
 								 1);
 				cache->dirty = 0;
-				cache->object = NULL;
 			}
 
 		} while (cache && chunkWritten > 0);
@@ -3941,75 +4099,91 @@ void yaffs_FlushEntireDeviceCache(yaffs_Device *dev)
 
 }
 
-
-/* Grab us a cache chunk for use.
- * First look for an empty one.
- * Then look for the least recently used non-dirty one.
- * Then look for the least recently used dirty one...., flush and look again.
+/* Find the least recently used entry that is neither dirty nor locked.
+ * Empty entries sit at the old end of the LRU, so they are found first.
  */
 static yaffs_ChunkCache *yaffs_GrabChunkCacheWorker(yaffs_Device *dev)
 {
-	int i;
+	struct ylist_head *i;
+	yaffs_ChunkCache *cache;
 
-	if (dev->nShortOpCaches > 0) {
-		for (i = 0; i < dev->nShortOpCaches; i++) {
-			if (!dev->srCache[i].object)
-				return &dev->srCache[i];
-		}
+	for (i = dev->srCacheLru.prev; i != &dev->srCacheLru; i = i->prev) {
+		cache = ylist_entry(i, yaffs_ChunkCache, lruLink);
+		if (!cache->dirty && !cache->locked)
+			return cache;
 	}
 
 	return NULL;
 }
 
-static yaffs_ChunkCache *yaffs_GrabChunkCache(yaffs_Device *dev)
+/* Every entry is dirty. Write back the oldest ones in one batch so the
+ * next few grabs don't each have to write. Writing a chunk can run GC,
+ * which can invalidate cache entries, so look for the oldest dirty entry
+ * again after each write.
+ */
+static void yaffs_WriteBackChunkCache(yaffs_Device *dev)
 {
+	struct ylist_head *i;
 	yaffs_ChunkCache *cache;
-	yaffs_Object *theObj;
-	int usage;
-	int i;
-	int pushout;
-
-	if (dev->nShortOpCaches > 0) {
-		/* Try find a non-dirty one... */
+	int batch = dev->nShortOpCaches / YAFFS_CACHE_WRITEBACK_FRACTION;
+
+	if (batch < 1)
+		batch = 1;
+
+	while (batch-- > 0) {
+		cache = NULL;
+		for (i = dev->srCacheLru.prev; i != &dev->srCacheLru;
+		     i = i->prev) {
+			cache = ylist_entry(i, yaffs_ChunkCache, lruLink);
+			if (cache->dirty && !cache->locked)
+				break;
+			cache = NULL;
+		}
 
-		cache = yaffs_GrabChunkCacheWorker(dev);
+		if (!cache)
+			break;
 
-		if (!cache) {
-			/* They were all dirty, find the last recently used object and flush
-			 * its cache, then  find again.
-			 * NB what's here is not very accurate, we actually flush the object
-			 * the last recently used page.
-			 */
+		if (yaffs_WriteChunkDataToObject(cache->object, cache->chunkId,
+						 cache->data, cache->nBytes,
+						 1) < 0) {
+			T(YAFFS_TRACE_ERROR,
+			  (TSTR("yaffs tragedy: no space during cache write" TENDSTR)));
+			break;
+		}
+		cache->dirty = 0;
+	}
+}
 
-			/* With locking we can't assume we can use entry zero */
+/* Grab a cache entry for chunkId of obj.
+ * Reuse the least recently used clean entry. If they are all dirty,
+ * write a batch back first.
+ */
+static yaffs_ChunkCache *yaffs_GrabChunkCache(yaffs_Object *obj, int chunkId)
+{
+	yaffs_Device *dev = obj->myDev;
+	yaffs_ChunkCache *cache;
 
-			theObj = NULL;
-			usage = -1;
-			cache = NULL;
-			pushout = -1;
+	if (dev->nShortOpCaches <= 0)
+		return NULL;
 
-			for (i = 0; i < dev->nShortOpCaches; i++) {
-				if (dev->srCache[i].object &&
-				    !dev->srCache[i].locked &&
-				    (dev->srCache[i].lastUse < usage || !cache)) {
-					usage = dev->srCache[i].lastUse;
-					theObj = dev->srCache[i].object;
-					cache = &dev->srCache[i];
-					pushout = i;
-				}
-			}
+	cache = yaffs_GrabChunkCacheWorker(dev);
 
-			if (!cache || cache->dirty) {
-				/* Flush and try again */
-				yaffs_FlushFilesChunkCache(theObj);
-				cache = yaffs_GrabChunkCacheWorker(dev);
-			}
+	if (!cache) {
+		yaffs_WriteBackChunkCache(dev);
+		cache = yaffs_GrabChunkCacheWorker(dev);
+	}
 
-		}
-		return cache;
-	} else
-		return NULL;
+	if (cache) {
+		ylist_del_init(&cache->hashLink);
+		cache->object = obj;
+		cache->chunkId = chunkId;
+		cache->dirty = 0;
+		cache->locked = 0;
+		ylist_add(&cache->hashLink,
+			  yaffs_ChunkCacheBucket(dev, obj, chunkId));
+	}
 
+	return cache;
 }
 
 /* Find a cached chunk */
@@ -4017,14 +4191,17 @@ static yaffs_ChunkCache *yaffs_FindChunkCache(const yaffs_Object *obj,
 					      int chunkId)
 {
 	yaffs_Device *dev = obj->myDev;
-	int i;
+	struct ylist_head *i;
+	yaffs_ChunkCache *cache;
+
 	if (dev->nShortOpCaches > 0) {
-		for (i = 0; i < dev->nShortOpCaches; i++) {
-			if (dev->srCache[i].object == obj &&
-			    dev->srCache[i].chunkId == chunkId) {
+		ylist_for_each(i, yaffs_ChunkCacheBucket(dev, obj, chunkId)) {
+			cache = ylist_entry(i, yaffs_ChunkCache, hashLink);
+			if (cache->object == obj &&
+			    cache->chunkId == chunkId) {
 				dev->cacheHits++;
 
-				return &dev->srCache[i];
+				return cache;
 			}
 		}
 	}
@@ -4037,18 +4214,8 @@ static void yaffs_UseChunkCache(yaffs_Device *dev, yaffs_ChunkCache *cache,
 {
 
 	if (dev->nShortOpCaches > 0) {
-		if (dev->srLastUse < 0 || dev->srLastUse > 100000000) {
-			/* Reset the cache usages */
-			int i;
-			for (i = 1; i < dev->nShortOpCaches; i++)
-				dev->srCache[i].lastUse = 0;
-
-			dev->srLastUse = 0;
-		}
-
-		dev->srLastUse++;
-
-		cache->lastUse = dev->srLastUse;
+		ylist_del(&cache->lruLink);
+		ylist_add(&cache->lruLink, &dev->srCacheLru);
 
 		if (isAWrite)
 			cache->dirty = 1;
@@ -4065,7 +4232,7 @@ static void yaffs_InvalidateChunkCache(yaffs_Object *object, int chunkId)
 		yaffs_ChunkCache *cache = yaffs_FindChunkCache(object, chunkId);
 
 		if (cache)
-			cache->object = NULL;
+			yaffs_ReleaseChunkCache(object->myDev, cache);
 	}
 }
 
@@ -4077,11 +4244,11 @@ static void yaffs_InvalidateWholeChunkCache(yaffs_Object *in)
 	int i;
 	yaffs_Device *dev = in->myDev;
 
-	if (dev->nShortOpCaches > 0) {
+	if (dev->nShortOpCaches > 0 && dev->srCache) {
 		/* Invalidate it. */
 		for (i = 0; i < dev->nShortOpCaches; i++) {
 			if (dev->srCache[i].object == in)
-				dev->srCache[i].object = NULL;
+				yaffs_ReleaseChunkCache(dev, &dev->srCache[i]);
 		}
 	}
 }
@@ -4703,11 +4870,7 @@ int yaffs_ReadDataFromFile(yaffs_Object *in, __u8 *buffer, loff_t offset,
 				/* If we can't find the data in the cache, then load it up. */
 
 				if (!cache) {
-					cache = yaffs_GrabChunkCache(in->myDev);
-					cache->object = in;
-					cache->chunkId = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
+					cache = yaffs_GrabChunkCache(in, chunk);
 					yaffs_ReadChunkDataFromObject(in, chunk,
 								      cache->
 								      data);
@@ -4754,6 +4917,99 @@ int yaffs_ReadDataFromFile(yaffs_Object *in, __u8 *buffer, loff_t offset,
 	return nDone;
 }
 
+#ifdef __KERNEL__
+
+/* Read a whole chunk with the device only held shared. With one chunk per
+ * group the tnode lookup is a plain walk of the tree, and the NAND read
+ * goes through readChunkDataShared(), so only the statistics need
+ * dev->readLock.
+ */
+static int yaffs_ReadChunkDataShared(yaffs_Object *in, int chunkInInode,
+				     __u8 *buffer)
+{
+	yaffs_Device *dev = in->myDev;
+	int chunkInNAND = yaffs_FindChunkInFile(in, chunkInInode, NULL);
+
+	if (chunkInNAND < 0) {
+		/* get sane (zero) data if you read a hole */
+		memset(buffer, 0, dev->nDataBytesPerChunk);
+		return YAFFS_OK;
+	}
+
+	if (dev->readChunkDataShared(dev, chunkInNAND - dev->chunkOffset,
+				     buffer) != YAFFS_OK)
+		return YAFFS_FAIL;
+
+	spin_lock(&dev->readLock);
+	dev->nPageReads++;
+	spin_unlock(&dev->readLock);
+	return YAFFS_OK;
+}
+
+/* Read file data with the device only held shared by the OS layer, so
+ * several readers can run at once. Only cached chunks and whole chunks
+ * that can be read straight into the buffer are handled: nothing here
+ * grabs a cache slot, takes a temp buffer or changes the tnode tree.
+ * dev->readLock only covers the cache lookup and LRU update; copies and
+ * NAND reads run concurrently. Cache slots are only reassigned with the
+ * device held exclusively, so a slot found here stays valid.
+ * Returns -1 if the range needs yaffs_ReadDataFromFile(), which the
+ * caller must then call with the device held exclusively.
+ */
+int yaffs_ReadDataFromFileShared(yaffs_Object *in, __u8 *buffer,
+				loff_t offset, int nBytes)
+{
+	int chunk;
+	__u32 start;
+	int nToCopy;
+	int n = nBytes;
+	int nDone = 0;
+	yaffs_ChunkCache *cache;
+
+	yaffs_Device *dev = in->myDev;
+
+	if (dev->inbandTags || !dev->readChunkDataShared ||
+	    dev->chunkGroupSize != 1)
+		return -1;
+
+	while (n > 0) {
+		yaffs_AddrToChunk(dev, offset, &chunk, &start);
+		chunk++;
+
+		if ((start + n) < dev->nDataBytesPerChunk)
+			nToCopy = n;
+		else
+			nToCopy = dev->nDataBytesPerChunk - start;
+
+		spin_lock(&dev->readLock);
+		cache = yaffs_FindChunkCache(in, chunk);
+		if (cache)
+			yaffs_UseChunkCache(dev, cache, 0);
+		spin_unlock(&dev->readLock);
+
+		if (cache) {
+			memcpy(buffer, &cache->data[start], nToCopy);
+		} else if (nToCopy == dev->nDataBytesPerChunk) {
+			/* ECC errors are handled by the exclusive path */
+			if (yaffs_ReadChunkDataShared(in, chunk, buffer) !=
+			    YAFFS_OK)
+				return -1;
+		} else {
+			/* Would have to load the chunk into the cache */
+			return -1;
+		}
+
+		n -= nToCopy;
+		offset += nToCopy;
+		buffer += nToCopy;
+		nDone += nToCopy;
+	}
+
+	return nDone;
+}
+
+#endif
+
 int yaffs_WriteDataToFile(yaffs_Object *in, const __u8 *buffer, loff_t offset,
 			int nBytes, int writeThrough)
 {
@@ -4833,11 +5089,7 @@ int yaffs_WriteDataToFile(yaffs_Object *in, const __u8 *buffer, loff_t offset,
 				if (!cache
 				    && yaffs_CheckSpaceForAllocation(in->
 								     myDev)) {
-					cache = yaffs_GrabChunkCache(in->myDev);
-					cache->object = in;
-					cache->chunkId = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
+					cache = yaffs_GrabChunkCache(in, chunk);
 					yaffs_ReadChunkDataFromObject(in, chunk,
 								      cache->
 								      data);
@@ -5757,6 +6009,8 @@ static int yaffs_Scan(yaffs_Device *dev)
 						YINIT_LIST_HEAD(&parent->variant.
 								directoryVariant.
 								children);
+						parent->variant.directoryVariant.
+								nameHash = NULL;
 					} else if (!parent || parent->variantType !=
 						   YAFFS_OBJECT_TYPE_DIRECTORY) {
 						/* Hoosterman, another problem....
@@ -6487,6 +6741,8 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 						YINIT_LIST_HEAD(&parent->variant.
 							directoryVariant.
 							children);
+						parent->variant.directoryVariant.
+							nameHash = NULL;
 					} else if (!parent || parent->variantType !=
 						   YAFFS_OBJECT_TYPE_DIRECTORY) {
 						/* Hoosterman, another problem....
@@ -6725,6 +6981,7 @@ static void yaffs_RemoveObjectFromDirectory(yaffs_Object *obj)
 
 
 	ylist_del_init(&obj->siblings);
+	ylist_del_init(&obj->nameLink);
 	obj->parent = NULL;
 	
 	yaffs_VerifyDirectory(parent);
@@ -6763,6 +7020,7 @@ static void yaffs_AddObjectToDirectory(yaffs_Object *directory,
 	/* Now add it */
 	ylist_add(&obj->siblings, &directory->variant.directoryVariant.children);
 	obj->parent = directory;
+	yaffs_NameIndexAdd(directory, obj);
 
 	if (directory == obj->myDev->unlinkedDir
 			|| directory == obj->myDev->deletedDir) {
@@ -6775,10 +7033,114 @@ static void yaffs_AddObjectToDirectory(yaffs_Object *directory,
 	yaffs_VerifyObjectInDirectory(obj);
 }
 
+/*
+ * Directory name index.
+ *
+ * Once a directory is big enough, its children are also hashed by name sum
+ * into directoryVariant.nameHash so that lookups only look at children with
+ * the same sum. Children whose sum is not known to be right (lazy loaded,
+ * no object header yet, or lost+found) go into the last bucket, which every
+ * lookup also checks. A child moves to its real bucket when its name is set.
+ */
+
+static struct ylist_head *yaffs_NameIndexBucket(yaffs_Object *directory,
+						yaffs_Object *obj)
+{
+	struct ylist_head *hash = directory->variant.directoryVariant.nameHash;
+
+	if (obj->lazyLoaded || obj->hdrChunk <= 0 ||
+	    obj->objectId == YAFFS_OBJECTID_LOSTNFOUND)
+		return &hash[YAFFS_NAME_HASH_BUCKETS];
+
+	return &hash[obj->sum % YAFFS_NAME_HASH_BUCKETS];
+}
+
+static void yaffs_NameIndexAdd(yaffs_Object *directory, yaffs_Object *obj)
+{
+	if (!directory->variant.directoryVariant.nameHash)
+		return;
+
+	ylist_del_init(&obj->nameLink);
+	ylist_add(&obj->nameLink, yaffs_NameIndexBucket(directory, obj));
+}
+
+static void yaffs_NameIndexRehash(yaffs_Object *obj)
+{
+	yaffs_Object *parent = obj->parent;
+
+	if (parent && parent->variantType == YAFFS_OBJECT_TYPE_DIRECTORY &&
+	    !ylist_empty(&obj->nameLink))
+		yaffs_NameIndexAdd(parent, obj);
+}
+
+static void yaffs_BuildNameIndex(yaffs_Object *directory)
+{
+	struct ylist_head *hash;
+	struct ylist_head *i;
+	int b;
+
+	hash = YMALLOC((YAFFS_NAME_HASH_BUCKETS + 1) * sizeof(struct ylist_head));
+	if (!hash)
+		return;		/* Not fatal, lookups stay linear */
+
+	for (b = 0; b <= YAFFS_NAME_HASH_BUCKETS; b++)
+		YINIT_LIST_HEAD(&hash[b]);
+	directory->variant.directoryVariant.nameHash = hash;
+
+	ylist_for_each(i, &directory->variant.directoryVariant.children)
+		yaffs_NameIndexAdd(directory,
+				   ylist_entry(i, yaffs_Object, siblings));
+}
+
+static int yaffs_ObjectNameMatches(yaffs_Object *l, const YCHAR *name,
+				   int sum, YCHAR *buffer)
+{
+	yaffs_CheckObjectDetailsLoaded(l);
+
+	/* Special case for lost-n-found */
+	if (l->objectId == YAFFS_OBJECTID_LOSTNFOUND)
+		return yaffs_strcmp(name, YAFFS_LOSTNFOUND_NAME) == 0;
+
+	if (yaffs_SumCompare(l->sum, sum) || l->hdrChunk <= 0) {
+		/* LostnFound chunk called Objxxx
+		 * Do a real check
+		 */
+		yaffs_GetObjectName(l, buffer, YAFFS_MAX_NAME_LENGTH + 1);
+		return yaffs_strncmp(name, buffer, YAFFS_MAX_NAME_LENGTH) == 0;
+	}
+
+	return 0;
+}
+
+static yaffs_Object *yaffs_FindObjectInNameIndex(yaffs_Object *directory,
+						 const YCHAR *name, int sum,
+						 YCHAR *buffer)
+{
+	struct ylist_head *hash = directory->variant.directoryVariant.nameHash;
+	struct ylist_head *i, *n;
+	yaffs_Object *l;
+
+	ylist_for_each(i, &hash[sum % YAFFS_NAME_HASH_BUCKETS]) {
+		l = ylist_entry(i, yaffs_Object, nameLink);
+		if (yaffs_ObjectNameMatches(l, name, sum, buffer))
+			return l;
+	}
+
+	/* Loading an object's details may move it out of this bucket */
+	ylist_for_each_safe(i, n, &hash[YAFFS_NAME_HASH_BUCKETS]) {
+		l = ylist_entry(i, yaffs_Object, nameLink);
+		if (yaffs_ObjectNameMatches(l, name, sum, buffer))
+			return l;
+	}
+
+	return NULL;
+}
+
 yaffs_Object *yaffs_FindObjectByName(yaffs_Object *directory,
 				     const YCHAR *name)
 {
 	int sum;
+	int nChildren = 0;
 
 	struct ylist_head *i;
 	YCHAR buffer[YAFFS_MAX_NAME_LENGTH + 1];
@@ -6805,32 +7167,28 @@ yaffs_Object *yaffs_FindObjectByName(yaffs_Object *directory,
 
 	sum = yaffs_CalcNameSum(name);
 
+	if (directory->variant.directoryVariant.nameHash)
+		return yaffs_FindObjectInNameIndex(directory, name, sum, buffer);
+
+	l = NULL;
 	ylist_for_each(i, &directory->variant.directoryVariant.children) {
 		if (i) {
 			l = ylist_entry(i, yaffs_Object, siblings);
+			nChildren++;
 
 			if (l->parent != directory)
 				YBUG();
 
-			yaffs_CheckObjectDetailsLoaded(l);
-
-			/* Special case for lost-n-found */
-			if (l->objectId == YAFFS_OBJECTID_LOSTNFOUND) {
-				if (yaffs_strcmp(name, YAFFS_LOSTNFOUND_NAME) == 0)
-					return l;
-			} else if (yaffs_SumCompare(l->sum, sum) || l->hdrChunk <= 0) {
-				/* LostnFound chunk called Objxxx
-				 * Do a real check
-				 */
-				yaffs_GetObjectName(l, buffer,
-						    YAFFS_MAX_NAME_LENGTH + 1);
-				if (yaffs_strncmp(name, buffer, YAFFS_MAX_NAME_LENGTH) == 0)
-					return l;
-			}
+			if (yaffs_ObjectNameMatches(l, name, sum, buffer))
+				break;
+			l = NULL;
 		}
 	}
 
-	return NULL;
+	if (nChildren > YAFFS_NAME_HASH_THRESHOLD)
+		yaffs_BuildNameIndex(directory);
+
+	return l;
 }
 
 
@@ -7319,6 +7677,7 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 		init_failed = 1;
 
 	dev->srCache = NULL;
+	dev->srCacheHash = NULL;
 	dev->gcCleanupList = NULL;
 
 
@@ -7326,28 +7685,46 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 	    dev->nShortOpCaches > 0) {
 		int i;
 		void *buf;
-		int srCacheBytes = dev->nShortOpCaches * sizeof(yaffs_ChunkCache);
+		int srCacheBytes;
+		int nBuckets;
 
 		if (dev->nShortOpCaches > YAFFS_MAX_SHORT_OP_CACHES)
 			dev->nShortOpCaches = YAFFS_MAX_SHORT_OP_CACHES;
 
+		srCacheBytes = dev->nShortOpCaches * sizeof(yaffs_ChunkCache);
+
+		/* One hash bucket per entry, rounded up to a power of 2 */
+		for (nBuckets = 1; nBuckets < dev->nShortOpCaches; nBuckets <<= 1)
+			;
+
 		dev->srCache =  YMALLOC(srCacheBytes);
+		dev->srCacheHash = YMALLOC(nBuckets * sizeof(struct ylist_head));
 
 		buf = (__u8 *) dev->srCache;
 
 		if (dev->srCache)
 			memset(dev->srCache, 0, srCacheBytes);
 
+		if (!dev->srCacheHash)
+			buf = NULL;
+
+		if (buf) {
+			dev->srCacheHashMask = nBuckets - 1;
+			for (i = 0; i < nBuckets; i++)
+				YINIT_LIST_HEAD(&dev->srCacheHash[i]);
+			YINIT_LIST_HEAD(&dev->srCacheLru);
+		}
+
 		for (i = 0; i < dev->nShortOpCaches && buf; i++) {
 			dev->srCache[i].object = NULL;
-			dev->srCache[i].lastUse = 0;
 			dev->srCache[i].dirty = 0;
+			YINIT_LIST_HEAD(&dev->srCache[i].hashLink);
+			ylist_add_tail(&dev->srCache[i].lruLink,
+				       &dev->srCacheLru);
 			dev->srCache[i].data = buf = YMALLOC_DMA(dev->totalBytesPerChunk);
 		}
 		if (!buf)
 			init_failed = 1;
-
-		dev->srLastUse = 0;
 	}
 
 	dev->cacheHits = 0;
@@ -7467,6 +7844,11 @@ void yaffs_Deinitialise(yaffs_Device *dev)
 			dev->srCache = NULL;
 		}
 
+		if (dev->srCacheHash) {
+			YFREE(dev->srCacheHash);
+			dev->srCacheHash = NULL;
+		}
+
 		YFREE(dev->gcCleanupList);
 
 		for (i = 0; i < YAFFS_N_TEMP_BUFFERS; i++)
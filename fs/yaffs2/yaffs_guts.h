@@ -60,6 +60,12 @@
 
 #define YAFFS_NOBJECT_BUCKETS		256
 
+/* Per-directory name index, built once a lookup walks this many children.
+ * The extra bucket holds children whose name sum cannot be trusted yet.
+ */
+#define YAFFS_NAME_HASH_BUCKETS		64
+#define YAFFS_NAME_HASH_THRESHOLD	32
+
 
 #define YAFFS_OBJECT_SPACE		0x40000
 
@@ -88,7 +94,8 @@
 
 /* */
 
-#define YAFFS_MAX_SHORT_OP_CACHES	20
+#define YAFFS_DEFAULT_SHORT_OP_CACHES	32
+#define YAFFS_MAX_SHORT_OP_CACHES	256
 
 #define YAFFS_N_TEMP_BUFFERS		6
 
@@ -113,9 +120,10 @@
 
 /* ChunkCache is used for short read/write operations.*/
 typedef struct {
+	struct ylist_head hashLink;	/* Hash chain, only while object is set */
+	struct ylist_head lruLink;	/* LRU list, most recently used first */
 	struct yaffs_ObjectStruct *object;
 	int chunkId;
-	int lastUse;
 	int dirty;
 	int nBytes;		/* Only valid if the cache is dirty */
 	int locked;		/* Can't push out or flush while locked. */
@@ -387,6 +395,7 @@ typedef struct {
 
 typedef struct {
 	struct ylist_head children;     /* list of child links */
+	struct ylist_head *nameHash;	/* name index, or NULL if not built */
 } yaffs_DirectoryStructure;
 
 typedef struct {
@@ -438,6 +447,7 @@ struct yaffs_ObjectStruct {
 	/* also used for linking up the free list */
 	struct yaffs_ObjectStruct *parent;
 	struct ylist_head siblings;
+	struct ylist_head nameLink;	/* entry in parent's name index */
 
 	/* Where's my object header in NAND? */
 	int hdrChunk;
@@ -600,6 +610,9 @@ struct yaffs_DeviceStruct {
 	/* Callback to mark the superblock dirsty */
 	void (*markSuperBlockDirty)(void *superblock);
 
+	/* Callback to wake a parked background GC, see backgroundGcParked */
+	void (*wakeBackgroundGc)(struct yaffs_DeviceStruct *dev);
+
 	int wideTnodesDisabled; /* Set to disable wide tnodes */
 
 	YCHAR *pathDividers;	/* String of legal path dividers */
@@ -632,11 +645,21 @@ struct yaffs_DeviceStruct {
 #ifdef __KERNEL__
 
 	struct semaphore sem;	/* Semaphore for waiting on erasure.*/
-	struct semaphore grossLock;	/* Gross locking semaphore */
+	struct rw_semaphore grossLock;	/* Gross lock, held shared by readpage */
+	spinlock_t readLock;	/* Serialises the chunk cache LRU and the
+				 * statistics for readers holding grossLock
+				 * shared.
+				 */
+	/* Read a chunk's data without tags or any device state, for readers
+	 * holding grossLock shared. NULL if the driver can't do that. */
+	int (*readChunkDataShared) (struct yaffs_DeviceStruct *dev,
+				    int chunkInNAND, __u8 *data);
 	__u8 *spareBuffer;	/* For mtdif2 use. Don't know the size of the buffer
 				 * at compile time so we have to allocate it.
 				 */
 	void (*putSuperFunc) (struct super_block *sb);
+	struct task_struct *bgThread;	/* Background GC thread */
+	int noBackgroundGc;	/* Mounted with no-background-gc */
 #endif
 
 	int isMounted;
@@ -708,6 +731,12 @@ struct yaffs_DeviceStruct {
 
 	__u32 *gcCleanupList;	/* objects to delete at the end of a GC. */
 	int nonAggressiveSkip;	/* GC state/mode */
+	int backgroundGc;	/* Set while the OS layer runs
+				 * yaffs_BackgroundGarbageCollect().
+				 */
+	int backgroundGcParked;	/* Background GC sleeps until the writers
+				 * call wakeBackgroundGc().
+				 */
 
 	/* Statistcs */
 	int nPageWrites;
@@ -717,6 +746,7 @@ struct yaffs_DeviceStruct {
 	int nGCCopies;
 	int garbageCollections;
 	int passiveGarbageCollections;
+	int backgroundGarbageCollections;
 	int nRetriedWrites;
 	int nRetiredBlocks;
 	int eccFixed;
@@ -741,7 +771,9 @@ struct yaffs_DeviceStruct {
 	int doingBufferedBlockRewrite;
 
 	yaffs_ChunkCache *srCache;
-	int srLastUse;
+	struct ylist_head *srCacheHash;
+	__u32 srCacheHashMask;
+	struct ylist_head srCacheLru;
 
 	int cacheHits;
 
@@ -815,6 +847,8 @@ int yaffs_GutsInitialise(yaffs_Device *dev);
 void yaffs_Deinitialise(yaffs_Device *dev);
 
 int yaffs_GetNumberOfFreeChunks(yaffs_Device *dev);
+int yaffs_BackgroundGarbageCollect(yaffs_Device *dev, int idle);
+int yaffs_BackgroundGcWanted(yaffs_Device *dev);
 
 int yaffs_RenameObject(yaffs_Object *oldDir, const YCHAR *oldName,
 		       yaffs_Object *newDir, const YCHAR *newName);
@@ -834,6 +868,10 @@ int yaffs_GetAttributes(yaffs_Object *obj, struct iattr *attr);
 /* File operations */
 int yaffs_ReadDataFromFile(yaffs_Object *obj, __u8 *buffer, loff_t offset,
 				int nBytes);
+#ifdef __KERNEL__
+int yaffs_ReadDataFromFileShared(yaffs_Object *obj, __u8 *buffer,
+				loff_t offset, int nBytes);
+#endif
 int yaffs_WriteDataToFile(yaffs_Object *obj, const __u8 *buffer, loff_t offset,
 				int nBytes, int writeThrough);
 int yaffs_ResizeFile(yaffs_Object *obj, loff_t newSize);
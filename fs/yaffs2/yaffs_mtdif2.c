@@ -187,6 +187,27 @@ int nandmtd2_ReadChunkWithTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
 		return YAFFS_FAIL;
 }
 
+#ifdef __KERNEL__
+/* Data only read: no tags, so dev->spareBuffer is not used and several
+ * readers can run at once. ECC problems are left to the caller to retry
+ * through nandmtd2_ReadChunkWithTagsFromNAND(), which records them.
+ */
+int nandmtd2_ReadChunkDataShared(yaffs_Device *dev, int chunkInNAND,
+				__u8 *data)
+{
+	struct mtd_info *mtd = (struct mtd_info *)(dev->genericDevice);
+	loff_t addr = ((loff_t) chunkInNAND) * dev->totalBytesPerChunk;
+	size_t dummy;
+
+	if (dev->inbandTags)
+		return YAFFS_FAIL;
+
+	if (mtd->read(mtd, addr, dev->nDataBytesPerChunk, &dummy, data))
+		return YAFFS_FAIL;
+	return YAFFS_OK;
+}
+#endif
+
 int nandmtd2_MarkNANDBlockBad(struct yaffs_DeviceStruct *dev, int blockNo)
 {
 	struct mtd_info *mtd = (struct mtd_info *)(dev->genericDevice);
@@ -0,0 +1,58 @@
+/*
+ * include/linux/goldfish_audio.h
+ *
+ * Copyright (C) 2007 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _LINUX_GOLDFISH_AUDIO_H
+#define _LINUX_GOLDFISH_AUDIO_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* Ring mode of /dev/eac, only available on emulators supporting it.
+ *
+ * Playback and capture each use a ring of 'periods' periods of
+ * 'period_bytes' bytes, which can be mapped at the given mmap offsets.
+ * Positions are free running byte counts: the application owns the bytes
+ * between appl_ptr and hw_ptr + ring size (playback) or between appl_ptr
+ * and hw_ptr (capture), and moves appl_ptr forward with
+ * GOLDFISH_AUDIO_ADVANCE. poll() reports POLLOUT/POLLIN once a full
+ * period can be written or read.
+ */
+struct goldfish_audio_ring_info {
+	__u32 period_bytes;
+	__u32 periods;
+	__u32 playback_offset;
+	__u32 capture_offset;	/* 0 if capture is not supported */
+};
+
+#define GOLDFISH_AUDIO_PLAYBACK	0
+#define GOLDFISH_AUDIO_CAPTURE	1
+
+struct goldfish_audio_pos {
+	__u32 dir;		/* GOLDFISH_AUDIO_PLAYBACK or _CAPTURE */
+	__u32 hw_ptr;		/* bytes played or captured by the emulator */
+	__u32 appl_ptr;		/* bytes written or consumed by the application */
+};
+
+#define __GOLDFISH_AUDIO_IOC	0x7c
+
+#define GOLDFISH_AUDIO_GET_RING_INFO \
+	_IOR(__GOLDFISH_AUDIO_IOC, 1, struct goldfish_audio_ring_info)
+#define GOLDFISH_AUDIO_GET_POS \
+	_IOWR(__GOLDFISH_AUDIO_IOC, 2, struct goldfish_audio_pos)
+#define GOLDFISH_AUDIO_ADVANCE \
+	_IOW(__GOLDFISH_AUDIO_IOC, 3, struct goldfish_audio_pos)
+
+#endif	/* _LINUX_GOLDFISH_AUDIO_H */
@@ -0,0 +1,43 @@
+/*
+ * include/linux/goldfishfb.h
+ *
+ * Copyright (C) 2007 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _LINUX_GOLDFISHFB_H
+#define _LINUX_GOLDFISHFB_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define GOLDFISHFB_MAX_RECTS	16
+
+struct goldfishfb_rect {
+	__u32 x;
+	__u32 y;
+	__u32 width;
+	__u32 height;
+};
+
+/* Regions of the next frame that changed, relative to the frame passed
+ * to the next FBIOPAN_DISPLAY. A count of 0 means the whole frame. The
+ * damage only applies to one pan and is reset afterwards.
+ */
+struct goldfishfb_damage {
+	__u32 count;
+	struct goldfishfb_rect rects[GOLDFISHFB_MAX_RECTS];
+};
+
+#define GOLDFISHFB_SET_DAMAGE	_IOW('F', 0x80, struct goldfishfb_damage)
+
+#endif	/* _LINUX_GOLDFISHFB_H */
@@ -3,6 +3,7 @@
 
 #include <asm/ioctl.h>
 #include <linux/types.h>
+#include <linux/fb.h>
 #include <linux/videodev2.h>
 
 struct matroxioc_output_mode {
@@ -37,7 +38,5 @@ enum matroxfb_ctrl_id {
   MATROXFB_CID_LAST
 };
 
-#define FBIO_WAITFORVSYNC	_IOW('F', 0x20, u_int32_t)
-
 #endif
 
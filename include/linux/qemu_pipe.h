@@ -0,0 +1,45 @@
+/*
+ * include/linux/qemu_pipe.h
+ *
+ * Copyright (C) 2011 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _LINUX_QEMU_PIPE_H
+#define _LINUX_QEMU_PIPE_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* Shared ring buffer set up with QEMU_PIPE_SETUP_RING. Mapping the pipe fd
+ * gives this header in the first page, followed by 'size' bytes of data.
+ * The guest copies data in at (head % size) and advances head, the emulator
+ * consumes it and advances tail. Both offsets are free running.
+ */
+struct qemu_pipe_ring {
+	__u32 head;	/* bytes produced by the guest */
+	__u32 tail;	/* bytes consumed by the emulator */
+	__u32 size;	/* size of the data area, in bytes */
+	__u32 flags;	/* QEMU_PIPE_RING_* flags, set by the emulator */
+};
+
+/* The emulator stopped polling the ring, QEMU_PIPE_RING_KICK is needed */
+#define QEMU_PIPE_RING_NEED_KICK	(1 << 0)
+
+#define __QEMU_PIPE_IOC		0x7b
+
+/* Argument is the data area size: a power of two number of pages */
+#define QEMU_PIPE_SETUP_RING	_IOW(__QEMU_PIPE_IOC, 1, __u32)
+#define QEMU_PIPE_RING_KICK	_IO(__QEMU_PIPE_IOC, 2)
+#define QEMU_PIPE_RING_WAIT	_IO(__QEMU_PIPE_IOC, 3)
+
+#endif	/* _LINUX_QEMU_PIPE_H */
@@ -0,0 +1,30 @@
+#ifndef _TRACE_BINDER_H
+#define _TRACE_BINDER_H
+
+#include <linux/tracepoint.h>
+
+DECLARE_TRACE(binder_transaction_queued,
+	TPPROTO(int debug_id, int reply, int from_pid, int from_tid,
+		int to_pid, int to_tid, unsigned int code, unsigned int flags),
+		TPARGS(debug_id, reply, from_pid, from_tid, to_pid, to_tid,
+		       code, flags));
+
+/* wait_us is the time the transaction spent queued */
+DECLARE_TRACE(binder_transaction_dequeued,
+	TPPROTO(int debug_id, int pid, int tid, s64 wait_us),
+		TPARGS(debug_id, pid, tid, wait_us));
+
+/* service_us is the time from delivery of the call to its reply */
+DECLARE_TRACE(binder_transaction_replied,
+	TPPROTO(int debug_id, int pid, int tid, s64 service_us),
+		TPARGS(debug_id, pid, tid, service_us));
+
+DECLARE_TRACE(binder_buffer_alloc,
+	TPPROTO(int pid, void *data, size_t size, int async),
+		TPARGS(pid, data, size, async));
+
+DECLARE_TRACE(binder_buffer_free,
+	TPPROTO(int pid, void *data, size_t size),
+		TPARGS(pid, data, size));
+
+#endif
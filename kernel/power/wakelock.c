@@ -45,6 +45,16 @@ module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 static DEFINE_SPINLOCK(list_lock);
 static LIST_HEAD(inactive_locks);
 static struct list_head active_wake_locks[WAKE_LOCK_TYPE_COUNT];
+/*
+ * Active locks with a timeout are also kept in expire_tree, ordered by
+ * lock->expires, so finding expired locks and the last expiry does not walk
+ * every active lock. untimed_count is the number of active locks without a
+ * timeout, and active_count all active locks; it is read without list_lock
+ * by has_wake_lock().
+ */
+static struct rb_root expire_tree[WAKE_LOCK_TYPE_COUNT];
+static int untimed_count[WAKE_LOCK_TYPE_COUNT];
+static atomic_t active_count[WAKE_LOCK_TYPE_COUNT];
 static int current_event_num;
 struct workqueue_struct *suspend_work_queue;
 struct wake_lock main_wake_lock;
@@ -156,26 +166,31 @@ static int wakelocks_read_proc(char *page, char **start, off_t off,
 	return len;
 }
 
-static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
+/*
+ * 'now' is sampled by the caller before taking list_lock, to keep the clock
+ * read out of the critical section.
+ */
+static void wake_unlock_stat_locked(struct wake_lock *lock, int expired,
+				    ktime_t now)
 {
 	ktime_t duration;
-	ktime_t now;
+	ktime_t end;
 	if (!(lock->flags & WAKE_LOCK_ACTIVE))
 		return;
-	if (get_expired_time(lock, &now))
+	if (get_expired_time(lock, &end))
 		expired = 1;
 	else
-		now = ktime_get();
+		end = now;
 	lock->stat.count++;
 	if (expired)
 		lock->stat.expire_count++;
-	duration = ktime_sub(now, lock->stat.last_time);
+	duration = ktime_sub(end, lock->stat.last_time);
 	lock->stat.total_time = ktime_add(lock->stat.total_time, duration);
 	if (ktime_to_ns(duration) > ktime_to_ns(lock->stat.max_time))
 		lock->stat.max_time = duration;
-	lock->stat.last_time = ktime_get();
+	lock->stat.last_time = now;
 	if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-		duration = ktime_sub(now, last_sleep_time_update);
+		duration = ktime_sub(end, last_sleep_time_update);
 		lock->stat.prevent_suspend_time = ktime_add(
 			lock->stat.prevent_suspend_time, duration);
 		lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
@@ -210,11 +225,53 @@ static void update_sleep_wait_stats_locked(int done)
 #endif
 
 
+/*
+ * link_active_locked/unlink_active_locked - add an active lock to, or remove
+ * it from, expire_tree and the counts, according to its current flags.
+ *
+ * Caller must hold list_lock.
+ */
+static void link_active_locked(struct wake_lock *lock, int type)
+{
+	struct rb_node **p = &expire_tree[type].rb_node;
+	struct rb_node *parent = NULL;
+
+	atomic_inc(&active_count[type]);
+	if (!(lock->flags & WAKE_LOCK_AUTO_EXPIRE)) {
+		untimed_count[type]++;
+		return;
+	}
+	while (*p) {
+		struct wake_lock *entry;
+
+		parent = *p;
+		entry = rb_entry(parent, struct wake_lock, expire_node);
+		if ((long)(lock->expires - entry->expires) < 0)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&lock->expire_node, parent, p);
+	rb_insert_color(&lock->expire_node, &expire_tree[type]);
+}
+
+static void unlink_active_locked(struct wake_lock *lock, int type)
+{
+	if (!(lock->flags & WAKE_LOCK_ACTIVE))
+		return;
+	atomic_dec(&active_count[type]);
+	if (lock->flags & WAKE_LOCK_AUTO_EXPIRE)
+		rb_erase(&lock->expire_node, &expire_tree[type]);
+	else
+		untimed_count[type]--;
+}
+
 static void expire_wake_lock(struct wake_lock *lock)
 {
 #ifdef CONFIG_WAKELOCK_STAT
-	wake_unlock_stat_locked(lock, 1);
+	wake_unlock_stat_locked(lock, 1, ktime_get());
 #endif
+	unlink_active_locked(lock, lock->flags & WAKE_LOCK_TYPE_MASK);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -244,27 +301,34 @@ static void print_active_locks(int type)
 
 static long has_wake_lock_locked(int type)
 {
-	struct wake_lock *lock, *n;
-	long max_timeout = 0;
+	struct rb_node *n;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
-	list_for_each_entry_safe(lock, n, &active_wake_locks[type], link) {
-		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-			long timeout = lock->expires - jiffies;
-			if (timeout <= 0)
-				expire_wake_lock(lock);
-			else if (timeout > max_timeout)
-				max_timeout = timeout;
-		} else
-			return -1;
+	if (untimed_count[type])
+		return -1;
+	while ((n = rb_first(&expire_tree[type]))) {
+		struct wake_lock *lock;
+
+		lock = rb_entry(n, struct wake_lock, expire_node);
+		if ((long)(lock->expires - jiffies) > 0)
+			break;
+		expire_wake_lock(lock);
 	}
-	return max_timeout;
+	n = rb_last(&expire_tree[type]);
+	if (!n)
+		return 0;
+	return rb_entry(n, struct wake_lock, expire_node)->expires - jiffies;
 }
 
 long has_wake_lock(int type)
 {
 	long ret;
 	unsigned long irqflags;
+
+	/* nothing active, not even an expired lock: no need for the lock */
+	if (!atomic_read(&active_count[type]))
+		return 0;
+
 	spin_lock_irqsave(&list_lock, irqflags);
 	ret = has_wake_lock_locked(type);
 	spin_unlock_irqrestore(&list_lock, irqflags);
@@ -376,6 +440,7 @@ void wake_lock_destroy(struct wake_lock *lock)
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_lock_destroy name=%s\n", lock->name);
 	spin_lock_irqsave(&list_lock, irqflags);
+	unlink_active_locked(lock, lock->flags & WAKE_LOCK_TYPE_MASK);
 	lock->flags &= ~WAKE_LOCK_INITIALIZED;
 #ifdef CONFIG_WAKELOCK_STAT
 	if (lock->stat.count) {
@@ -403,6 +468,9 @@ static void wake_lock_internal(
 	int type;
 	unsigned long irqflags;
 	long expire_in;
+#ifdef CONFIG_WAKELOCK_STAT
+	ktime_t now = ktime_get();
+#endif
 
 	spin_lock_irqsave(&list_lock, irqflags);
 	type = lock->flags & WAKE_LOCK_TYPE_MASK;
@@ -417,14 +485,15 @@ static void wake_lock_internal(
 	}
 	if ((lock->flags & WAKE_LOCK_AUTO_EXPIRE) &&
 	    (long)(lock->expires - jiffies) <= 0) {
-		wake_unlock_stat_locked(lock, 0);
-		lock->stat.last_time = ktime_get();
+		wake_unlock_stat_locked(lock, 0, now);
+		lock->stat.last_time = now;
 	}
 #endif
+	unlink_active_locked(lock, type);
 	if (!(lock->flags & WAKE_LOCK_ACTIVE)) {
 		lock->flags |= WAKE_LOCK_ACTIVE;
 #ifdef CONFIG_WAKELOCK_STAT
-		lock->stat.last_time = ktime_get();
+		lock->stat.last_time = now;
 #endif
 	}
 	list_del(&lock->link);
@@ -443,6 +512,7 @@ static void wake_lock_internal(
 		lock->flags &= ~WAKE_LOCK_AUTO_EXPIRE;
 		list_add(&lock->link, &active_wake_locks[type]);
 	}
+	link_active_locked(lock, type);
 	if (type == WAKE_LOCK_SUSPEND) {
 		current_event_num++;
 #ifdef CONFIG_WAKELOCK_STAT
@@ -488,13 +558,17 @@ void wake_unlock(struct wake_lock *lock)
 {
 	int type;
 	unsigned long irqflags;
+#ifdef CONFIG_WAKELOCK_STAT
+	ktime_t now = ktime_get();
+#endif
 	spin_lock_irqsave(&list_lock, irqflags);
 	type = lock->flags & WAKE_LOCK_TYPE_MASK;
 #ifdef CONFIG_WAKELOCK_STAT
-	wake_unlock_stat_locked(lock, 0);
+	wake_unlock_stat_locked(lock, 0, now);
 #endif
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_unlock: %s\n", lock->name);
+	unlink_active_locked(lock, type);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -536,8 +610,10 @@ static int __init wakelocks_init(void)
 	int ret;
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++)
+	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++) {
 		INIT_LIST_HEAD(&active_wake_locks[i]);
+		expire_tree[i] = RB_ROOT;
+	}
 
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_lock_init(&deleted_wake_locks, WAKE_LOCK_SUSPEND,
@@ -27,6 +27,8 @@
 #include <linux/personality.h>
 #include <linux/bitops.h>
 #include <linux/mutex.h>
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
 #include <linux/shmem_fs.h>
 #include <linux/ashmem.h>
 
@@ -37,12 +39,13 @@
 /*
  * ashmem_area - anonymous shared memory area
  * Lifecycle: From our parent file's open() until its release()
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its own `mutex'
  * Big Note: Mappings do NOT pin this structure; it dies on close()
  */
 struct ashmem_area {
 	char name[ASHMEM_FULL_NAME_LEN];/* optional name for /proc/pid/maps */
-	struct list_head unpinned_list;	/* list of all ashmem areas */
+	struct mutex mutex;		/* protects everything below */
+	struct rb_root unpinned_root;	/* unpinned ranges, by pgstart */
 	struct file *file;		/* the shmem-based backing file */
 	size_t size;			/* size of the mapping, in bytes */
 	unsigned long prot_mask;	/* allowed prot bits, as vm_flags */
@@ -51,29 +54,32 @@ struct ashmem_area {
 /*
  * ashmem_range - represents an interval of unpinned (evictable) pages
  * Lifecycle: From unpin to pin
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its area's `mutex'; `lru' also by `ashmem_lru_lock'
  */
 struct ashmem_range {
 	struct list_head lru;		/* entry in LRU list */
-	struct list_head unpinned;	/* entry in its area's unpinned list */
+	struct rb_node node;		/* entry in its area's unpinned tree */
 	struct ashmem_area *asma;	/* associated area */
 	size_t pgstart;			/* starting page, inclusive */
 	size_t pgend;			/* ending page, inclusive */
 	unsigned int purged;		/* ASHMEM_NOT or ASHMEM_WAS_PURGED */
 };
 
-/* LRU list of unpinned pages, protected by ashmem_mutex */
+/* LRU list of unpinned pages, protected by ashmem_lru_lock */
 static LIST_HEAD(ashmem_lru_list);
 
-/* Count of pages on our LRU list, protected by ashmem_mutex */
+/* Count of pages on our LRU list, protected by ashmem_lru_lock */
 static unsigned long lru_count;
 
 /*
- * ashmem_mutex - protects the list of and each individual ashmem_area
+ * ashmem_lru_lock - protects the LRU list and count. Each ashmem_area has its
+ * own mutex, so operations on different areas do not contend; the shrinker
+ * only trylocks areas and skips the ones that are busy.
  *
- * Lock Ordering: ashmex_mutex -> i_mutex -> i_alloc_sem
+ * Lock Ordering: asma->mutex -> ashmem_lru_lock
+ *                asma->mutex -> i_mutex -> i_alloc_sem
  */
-static DEFINE_MUTEX(ashmem_mutex);
+static DEFINE_SPINLOCK(ashmem_lru_lock);
 
 static struct kmem_cache *ashmem_area_cachep __read_mostly;
 static struct kmem_cache *ashmem_range_cachep __read_mostly;
@@ -97,38 +103,74 @@ static struct kmem_cache *ashmem_range_cachep __read_mostly;
   (page_in_range(range, start) || page_in_range(range, end) || \
    page_range_subsumes_range(range, start, end))
 
-#define range_before_page(range, page) \
-  ((range)->pgend < (page))
-
 #define PROT_MASK		(PROT_EXEC | PROT_READ | PROT_WRITE)
 
+/* Caller must hold ashmem_lru_lock */
 static inline void lru_add(struct ashmem_range *range)
 {
 	list_add_tail(&range->lru, &ashmem_lru_list);
 	lru_count += range_size(range);
 }
 
+/* Caller must hold ashmem_lru_lock */
 static inline void lru_del(struct ashmem_range *range)
 {
 	list_del(&range->lru);
 	lru_count -= range_size(range);
 }
 
+/*
+ * range_first - returns the lowest unpinned range of 'asma' that overlaps
+ * [start, end], or NULL. The ranges never overlap each other, so ordering
+ * them by pgstart also orders them by pgend.
+ *
+ * Caller must hold asma->mutex.
+ */
+static struct ashmem_range *range_first(struct ashmem_area *asma,
+					size_t start, size_t end)
+{
+	struct rb_node *n = asma->unpinned_root.rb_node;
+	struct ashmem_range *found = NULL;
+
+	while (n) {
+		struct ashmem_range *range;
+
+		range = rb_entry(n, struct ashmem_range, node);
+		if (range->pgend < start)
+			n = n->rb_right;
+		else {
+			found = range;
+			n = n->rb_left;
+		}
+	}
+
+	if (found && found->pgstart > end)
+		return NULL;
+	return found;
+}
+
+static inline struct ashmem_range *range_next(struct ashmem_range *range)
+{
+	struct rb_node *n = rb_next(&range->node);
+
+	return n ? rb_entry(n, struct ashmem_range, node) : NULL;
+}
+
 /*
  * range_alloc - allocate and initialize a new ashmem_range structure
  *
  * 'asma' - associated ashmem_area
- * 'prev_range' - the previous ashmem_range in the sorted asma->unpinned list
  * 'purged' - initial purge value (ASMEM_NOT_PURGED or ASHMEM_WAS_PURGED)
  * 'start' - starting page, inclusive
  * 'end' - ending page, inclusive
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
-static int range_alloc(struct ashmem_area *asma,
-		       struct ashmem_range *prev_range, unsigned int purged,
+static int range_alloc(struct ashmem_area *asma, unsigned int purged,
 		       size_t start, size_t end)
 {
+	struct rb_node **p = &asma->unpinned_root.rb_node;
+	struct rb_node *parent = NULL;
 	struct ashmem_range *range;
 
 	range = kmem_cache_zalloc(ashmem_range_cachep, GFP_KERNEL);
@@ -140,26 +182,47 @@ static int range_alloc(struct ashmem_area *asma,
 	range->pgend = end;
 	range->purged = purged;
 
-	list_add_tail(&range->unpinned, &prev_range->unpinned);
+	while (*p) {
+		struct ashmem_range *entry;
 
-	if (range_on_lru(range))
+		parent = *p;
+		entry = rb_entry(parent, struct ashmem_range, node);
+		if (start < entry->pgstart)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&range->node, parent, p);
+	rb_insert_color(&range->node, &asma->unpinned_root);
+
+	if (range_on_lru(range)) {
+		spin_lock(&ashmem_lru_lock);
 		lru_add(range);
+		spin_unlock(&ashmem_lru_lock);
+	}
 
 	return 0;
 }
 
+/* Caller must hold asma->mutex */
 static void range_del(struct ashmem_range *range)
 {
-	list_del(&range->unpinned);
-	if (range_on_lru(range))
+	rb_erase(&range->node, &range->asma->unpinned_root);
+	if (range_on_lru(range)) {
+		spin_lock(&ashmem_lru_lock);
 		lru_del(range);
+		spin_unlock(&ashmem_lru_lock);
+	}
 	kmem_cache_free(ashmem_range_cachep, range);
 }
 
 /*
  * range_shrink - shrinks a range
  *
- * Caller must hold ashmem_mutex.
+ * The range keeps its place in the tree, as it still lies between its
+ * neighbours.
+ *
+ * Caller must hold asma->mutex.
  */
 static inline void range_shrink(struct ashmem_range *range,
 				size_t start, size_t end)
@@ -169,8 +232,11 @@ static inline void range_shrink(struct ashmem_range *range,
 	range->pgstart = start;
 	range->pgend = end;
 
-	if (range_on_lru(range))
+	if (range_on_lru(range)) {
+		spin_lock(&ashmem_lru_lock);
 		lru_count -= pre - range_size(range);
+		spin_unlock(&ashmem_lru_lock);
+	}
 }
 
 static int ashmem_open(struct inode *inode, struct file *file)
@@ -186,7 +252,8 @@ static int ashmem_open(struct inode *inode, struct file *file)
 	if (unlikely(!asma))
 		return -ENOMEM;
 
-	INIT_LIST_HEAD(&asma->unpinned_list);
+	mutex_init(&asma->mutex);
+	asma->unpinned_root = RB_ROOT;
 	memcpy(asma->name, ASHMEM_NAME_PREFIX, ASHMEM_NAME_PREFIX_LEN);
 	asma->prot_mask = PROT_MASK;
 	file->private_data = asma;
@@ -197,12 +264,12 @@ static int ashmem_open(struct inode *inode, struct file *file)
 static int ashmem_release(struct inode *ignored, struct file *file)
 {
 	struct ashmem_area *asma = file->private_data;
-	struct ashmem_range *range, *next;
+	struct rb_node *n;
 
-	mutex_lock(&ashmem_mutex);
-	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned)
-		range_del(range);
-	mutex_unlock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
+	while ((n = rb_first(&asma->unpinned_root)))
+		range_del(rb_entry(n, struct ashmem_range, node));
+	mutex_unlock(&asma->mutex);
 
 	if (asma->file)
 		fput(asma->file);
@@ -216,7 +283,7 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	struct ashmem_area *asma = file->private_data;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* user needs to SET_SIZE before mapping */
 	if (unlikely(!asma->size)) {
@@ -257,7 +324,7 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	vma->vm_flags |= VM_CAN_NONLINEAR;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -275,32 +342,51 @@ out:
  * We approximate LRU via least-recently-unpinned, jettisoning unpinned partial
  * chunks of ashmem regions LRU-wise one-at-a-time until we hit 'nr_to_scan'
  * pages freed.
+ *
+ * Only the area being purged is locked while its pages are truncated, and
+ * areas whose mutex is held are skipped rather than waited for.
  */
 static int ashmem_shrink(int nr_to_scan, gfp_t gfp_mask)
 {
-	struct ashmem_range *range, *next;
-
 	/* We might recurse into filesystem code, so bail out if necessary */
 	if (nr_to_scan && !(gfp_mask & __GFP_FS))
 		return -1;
 	if (!nr_to_scan)
 		return lru_count;
 
-	mutex_lock(&ashmem_mutex);
-	list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
-		struct inode *inode = range->asma->file->f_dentry->d_inode;
-		loff_t start = range->pgstart * PAGE_SIZE;
-		loff_t end = (range->pgend + 1) * PAGE_SIZE - 1;
+	while (nr_to_scan > 0) {
+		struct ashmem_range *range;
+		struct ashmem_area *asma = NULL;
+		struct inode *inode;
+		loff_t start, end;
 
-		vmtruncate_range(inode, start, end);
-		range->purged = ASHMEM_WAS_PURGED;
+		/*
+		 * The range cannot go away once its area is locked: it is
+		 * only removed from the LRU under both locks.
+		 */
+		spin_lock(&ashmem_lru_lock);
+		list_for_each_entry(range, &ashmem_lru_list, lru) {
+			if (mutex_trylock(&range->asma->mutex)) {
+				asma = range->asma;
+				break;
+			}
+		}
+		if (!asma) {
+			spin_unlock(&ashmem_lru_lock);
+			break;
+		}
 		lru_del(range);
+		range->purged = ASHMEM_WAS_PURGED;
+		spin_unlock(&ashmem_lru_lock);
 
+		inode = asma->file->f_dentry->d_inode;
+		start = range->pgstart * PAGE_SIZE;
+		end = (range->pgend + 1) * PAGE_SIZE - 1;
 		nr_to_scan -= range_size(range);
-		if (nr_to_scan <= 0)
-			break;
+
+		vmtruncate_range(inode, start, end);
+		mutex_unlock(&asma->mutex);
 	}
-	mutex_unlock(&ashmem_mutex);
 
 	return lru_count;
 }
@@ -314,7 +400,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* the user can only remove, not add, protection bits */
 	if (unlikely((asma->prot_mask & prot) != prot)) {
@@ -329,7 +415,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 	asma->prot_mask = prot;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -337,7 +423,7 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* cannot change an existing mapping's name */
 	if (unlikely(asma->file)) {
@@ -351,7 +437,7 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 	asma->name[ASHMEM_FULL_NAME_LEN-1] = '\0';
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
@@ -360,7 +446,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 	if (asma->name[ASHMEM_NAME_PREFIX_LEN] != '\0') {
 		size_t len;
 
@@ -377,7 +463,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 					  sizeof(ASHMEM_NAME_DEF))))
 			ret = -EFAULT;
 	}
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
@@ -386,17 +472,16 @@ static int get_name(struct ashmem_area *asma, void __user *name)
  * ashmem_pin - pin the given ashmem region, returning whether it was
  * previously purged (ASHMEM_WAS_PURGED) or not (ASHMEM_NOT_PURGED).
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
 	struct ashmem_range *range, *next;
 	int ret = ASHMEM_NOT_PURGED;
 
-	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned) {
-		/* moved past last applicable page; we can short circuit */
-		if (range_before_page(range, pgstart))
-			break;
+	for (range = range_first(asma, pgstart, pgend);
+	     range && range->pgstart <= pgend; range = next) {
+		next = range_next(range);
 
 		/*
 		 * The user can ask us to pin pages that span multiple ranges,
@@ -439,7 +524,7 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 			 * more complicated, we allocate a new range for the
 			 * second half and adjust the first chunk's endpoint.
 			 */
-			range_alloc(asma, range, range->purged,
+			range_alloc(asma, range->purged,
 				    pgend + 1, range->pgend);
 			range_shrink(range, range->pgstart, pgstart - 1);
 			break;
@@ -452,59 +537,42 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 /*
  * ashmem_unpin - unpin the given range of pages. Returns zero on success.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_unpin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
-	struct ashmem_range *range, *next;
+	struct ashmem_range *range;
 	unsigned int purged = ASHMEM_NOT_PURGED;
 
-restart:
-	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned) {
-		/* short circuit: this is our insertion point */
-		if (range_before_page(range, pgstart))
-			break;
-
-		/*
-		 * The user can ask us to unpin pages that are already entirely
-		 * or partially pinned. We handle those two cases here.
-		 */
+	/*
+	 * The user can ask us to unpin pages that are already entirely
+	 * or partially unpinned. We handle those two cases here.
+	 */
+	while ((range = range_first(asma, pgstart, pgend))) {
 		if (page_range_subsumed_by_range(range, pgstart, pgend))
 			return 0;
-		if (page_range_in_range(range, pgstart, pgend)) {
-			pgstart = min_t(size_t, range->pgstart, pgstart),
-			pgend = max_t(size_t, range->pgend, pgend);
-			purged |= range->purged;
-			range_del(range);
-			goto restart;
-		}
+		pgstart = min_t(size_t, range->pgstart, pgstart);
+		pgend = max_t(size_t, range->pgend, pgend);
+		purged |= range->purged;
+		range_del(range);
 	}
 
-	return range_alloc(asma, range, purged, pgstart, pgend);
+	return range_alloc(asma, purged, pgstart, pgend);
 }
 
 /*
  * ashmem_get_pin_status - Returns ASHMEM_IS_UNPINNED if _any_ pages in the
  * given interval are unpinned and ASHMEM_IS_PINNED otherwise.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_get_pin_status(struct ashmem_area *asma, size_t pgstart,
 				 size_t pgend)
 {
-	struct ashmem_range *range;
-	int ret = ASHMEM_IS_PINNED;
+	if (range_first(asma, pgstart, pgend))
+		return ASHMEM_IS_UNPINNED;
 
-	list_for_each_entry(range, &asma->unpinned_list, unpinned) {
-		if (range_before_page(range, pgstart))
-			break;
-		if (page_range_in_range(range, pgstart, pgend)) {
-			ret = ASHMEM_IS_UNPINNED;
-			break;
-		}
-	}
-
-	return ret;
+	return ASHMEM_IS_PINNED;
 }
 
 static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
@@ -536,7 +604,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 	pgstart = pin.offset / PAGE_SIZE;
 	pgend = pgstart + (pin.len / PAGE_SIZE) - 1;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	switch (cmd) {
 	case ASHMEM_PIN:
@@ -550,7 +618,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 		break;
 	}
 
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
@@ -569,10 +637,12 @@ static long ashmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		break;
 	case ASHMEM_SET_SIZE:
 		ret = -EINVAL;
+		mutex_lock(&asma->mutex);
 		if (!asma->file) {
 			ret = 0;
 			asma->size = (size_t) arg;
 		}
+		mutex_unlock(&asma->mutex);
 		break;
 	case ASHMEM_GET_SIZE:
 		ret = asma->size;